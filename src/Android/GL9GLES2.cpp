@@ -772,6 +772,11 @@ void gl9Enable( GLenum cap ) {
     { auto err = glGetError(); assert(err == GL_NO_ERROR); }
 #endif
 }
+void gl9Finish( void ) { ::glFinish();
+#ifdef DEBUG
+    { auto err = glGetError(); assert(err == GL_NO_ERROR); }
+#endif
+}
 void gl9Flush( void ) { ::glFlush();
 #ifdef DEBUG
     { auto err = glGetError(); assert(err == GL_NO_ERROR); }
@@ -833,6 +838,17 @@ void gl9Viewport( GLint x, GLint y, GLsizei width, GLsizei height ) { ::glViewpo
 #endif
 }
 
+bool gl9WideIndicies()
+{
+    // a whole name in the space separated list
+    const char* szExt = "GL_OES_element_index_uint";
+    const size_t len = strlen( szExt );
+    auto szExts = (const char*)glGetString(GL_EXTENSIONS);
+    for( const char* p = szExts; p && ( p = strstr( p, szExt ) ); p += len )
+        if( ( p == szExts || p[-1] == ' ' ) && ( p[len] == ' ' || p[len] == '\0' ) ) return true;
+    return false;
+}
+
 void gl9RenderFrame(std::function<void(void)> fnRender, const char *filename)
 {
     assert(state.imp_type == GL_UNSIGNED_SHORT_5_6_5); // the only codepath here!
@@ -411,6 +411,7 @@ void AppPlatform::Bind(std::function<void(void)> rebindFn_, std::function<void(v
 {
     state.rebindFn = rebindFn_;
     state.releaseFn = releaseFn_;
+    frameTargetMSec = 16; // vsync, at 60Hz
 
     state.sensorManager = AcquireASensorManagerInstance( state.app );
     state.accelerometerSensor = ASensorManager_getDefaultSensor( state.sensorManager, ASENSOR_TYPE_ACCELEROMETER );
@@ -21,6 +21,7 @@
 #include "TriTools.hpp"
 #include "AppPlatform.hpp"
 #include "AppTime.hpp"
+#include "AppScheduler.hpp"
 #include "AppTutorial.hpp"
 #include "AppLog.hpp"
 #include "AppTriBrusher.hpp"
@@ -29,6 +30,7 @@
 #include "AppTexture.hpp"
 #include "AppFile.hpp"
 #include "AppML.hpp"
+#include "AppJobs.hpp"
 
 #include "RSphere.hpp"
 #include "RIcosahedron.hpp"
@@ -64,17 +66,6 @@ const char* Platform_ExternalPath();
 inline float glLength(const glm::vec2& vec) { return sqrt( glm::dot(vec, vec) ); }
 inline float glLength(const glm::vec3& vec) { return sqrt( glm::dot(vec, vec) ); }
 
-// Ericson, p130
-inline float glSegmentPointDistanceSq(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
-{
-    const glm::vec3 ab = b - a, ac = c - a, bc = c - b;
-    float e = glm::dot(ac, ab);
-    if(e <= 0.f) return glm::dot(ac, ac);
-    float f = glm::dot(ab, ab);
-    if( e >= f ) return glm::dot(bc, bc);
-    return glm::dot(ac, ac) - e * e / f;
-}
-
 struct Touch {
     // use a tri-state to process an ending-touch-position on the 'active' codepath
     // but ensure that that state reverts to 'false' on next tick.
@@ -111,11 +102,9 @@ struct TwoFinger
     }
 };
 
-// perf tune in conjunction with
-// - model chicklet-size
-// - model buffer-update strategy
-// - target hardware
-const uint kStrokeTune = 200;
+// iterations of brush work between checks of the scheduler's clock
+const uint kStrokeBatch = 32;
+const float kReleaseSec = .25f; // at most, to paint what a stroke's frames left when it's released
 
 // must be reset on app-entry as well as here
 bool appQuit = false;
@@ -167,7 +156,8 @@ RMenu menu;
 std::deque< std::unique_ptr<RText> > dialogStack;
 RColorPicker colorPicker;
 AppTriBrusher triBrusher;
-AppNormalBrusher normalBrusher;
+AppNormalBrusher<RSphere> normalBrusher;
+AppScheduler scheduler;
 
 glm::vec3 paintColor;
 glm::vec3 backColor = {0,0,0};
@@ -209,64 +199,100 @@ glm::vec3 fnProject(glm::vec3 pos3d)
     return projectedPoint;
 }
 
-void fnPaintColor(triID_type triID, float patchEffect, float handleEffect)
+// the falloff all the tools share, from a ring of tris at a time. their centers are gathered into
+// arrays by coord so the distances to the segment below the collision tri go in one loop
+struct PatchFalloff
 {
-//    MODEL.BrushColor( triID, paintColor, 1.0f );
-    MODEL.BrushColor( triID, paintColor, patchEffect ); // hack?
-}
+    serial_type serial = 0;
+    glm::vec3 center_coll;
+    glm::vec3 root;
+    std::vector<float> centerX, centerY, centerZ;
 
-void fnPaintInflate(triID_type triID, float patchEffect, float handleEffect)
-{
-    MODEL.BrushPos( triID, +MODEL.normTris[triID], .05f * patchEffect );
-    normalBrusher.Continue( triID );
-}
+    void Effects(const triID_type* tris, uint n, float* effects_out)
+    {
+        const float a_third( 1.f / 3.f );
+        const vertarray_type& posVerts = MODEL.posVerts;
+        const triID_type triColl = triBrusher.searchCxt.collisionTri;
+        const float patchSize = triBrusher.patchSize;
 
-void fnPaintDeflate(triID_type triID, float patchEffect, float handleEffect)
-{
-    MODEL.BrushPos( triID, -MODEL.normTris[triID], .05f * patchEffect );
-    normalBrusher.Continue( triID );
-}
+        if( serial != triBrusher.adjSerial )
+        {
+            serial = triBrusher.adjSerial;
+            const ind3_type indTri_coll = MODEL.indTriVerts[triColl];
+            center_coll = ( posVerts[indTri_coll.x] + posVerts[indTri_coll.y] + posVerts[indTri_coll.z] ) * a_third;
+            root = center_coll - MODEL.normTris[triColl] * patchSize;
+        }
 
-void fnPaintHandle(triID_type triID, float patchEffect, float handleEffect)
-{
-    MODEL.BrushPos( triID, MODEL.normTris[triID], .01f * handleEffect * patchEffect );
-    normalBrusher.Continue( triID );
-}
+        centerX.resize( n ); centerY.resize( n ); centerZ.resize( n );
+        for( uint i = 0; i < n; i++ )
+        {
+            const ind3_type indTri = MODEL.indTriVerts[ tris[ i ] ];
+            const glm::vec3 center = ( posVerts[ indTri.x ] + posVerts[ indTri.y ] + posVerts[ indTri.z ] ) * a_third;
+            centerX[ i ] = center.x; centerY[ i ] = center.y; centerZ[ i ] = center.z;
+        }
 
-struct PaintEffectorState
-{
-    serial_type serial = 0;
-    ind3_type indTri_coll;
-    glm::vec3 center_coll;
-    glm::vec3 root;
+        // segment to point distance, Ericson p130, with selects for its early outs
+        const glm::vec3 ab = center_coll - root;
+        const float f = glm::dot(ab, ab);
+        const float* cx = centerX.data();
+        const float* cy = centerY.data();
+        const float* cz = centerZ.data();
+        for( uint i = 0; i < n; i++ )
+        {
+            const float acx = cx[ i ] - root.x, acy = cy[ i ] - root.y, acz = cz[ i ] - root.z;
+            const float bcx = cx[ i ] - center_coll.x, bcy = cy[ i ] - center_coll.y, bcz = cz[ i ] - center_coll.z;
+            const float e = acx * ab.x + acy * ab.y + acz * ab.z;
+            const float acac = acx * acx + acy * acy + acz * acz;
+            const float bcbc = bcx * bcx + bcy * bcy + bcz * bcz;
+            const float distSq = e <= 0.f ? acac : ( e >= f ? bcbc : acac - e * e / f );
+
+            const float dist = std::sqrt( distSq );
+            effects_out[ i ] = dist <= patchSize ? 1.f - dist / patchSize : -1.f;
+        }
+
+        for( uint i = 0; i < n; i++ )
+            if( tris[ i ] == triColl ) effects_out[ i ] = .5f; // hack to prevent nipple
+    }
 };
-static PaintEffectorState pfe;
+static PatchFalloff patchFalloff;
 
-std::pair<bool, float> fnPaintEffector(triID_type t)
+struct ColorTool
 {
-    const float a_third( 1.f / 3.f );
-    const std::vector<glm::vec3>& posVerts = MODEL.posVerts;
-
-    if( pfe.serial != triBrusher.adjSerial )
+    void Effects(const triID_type* tris, uint n, float* effects_out) { patchFalloff.Effects( tris, n, effects_out ); }
+    void Paint(triID_type triID, float patchEffect, float handleEffect)
     {
-        pfe.serial = triBrusher.adjSerial;
-        pfe.indTri_coll = MODEL.indTriVerts[triBrusher.searchCxt.collisionTri];
-        pfe.center_coll = ( posVerts[pfe.indTri_coll.x] + posVerts[pfe.indTri_coll.y] + posVerts[pfe.indTri_coll.z] ) * a_third;
-        pfe.root = pfe.center_coll - MODEL.normTris[triBrusher.searchCxt.collisionTri] * triBrusher.patchSize;
+        MODEL.BrushColor( triID, paintColor, patchEffect ); // hack?
     }
+};
 
-    if( triBrusher.searchCxt.collisionTri == t )
-        return std::make_pair<bool, float>(true, .5f); // hack to prevent nipple
-
-    const ind3_type indTri = MODEL.indTriVerts[ t ];
-    const glm::vec3 center = ( posVerts[ indTri.x ] + posVerts[ indTri.y ] + posVerts[ indTri.z ] ) * a_third;
-
-    const float dist = std::sqrt( glSegmentPointDistanceSq( pfe.root, pfe.center_coll, center ) );
+template<int Sign>
+struct SwellTool
+{
+    void Effects(const triID_type* tris, uint n, float* effects_out) { patchFalloff.Effects( tris, n, effects_out ); }
+    void Paint(triID_type triID, float patchEffect, float handleEffect)
+    {
+        MODEL.BrushPos( triID, float( Sign ) * MODEL.normTris[triID], .05f * patchEffect );
+        normalBrusher.Continue( triID );
+    }
+};
+using InflateTool = SwellTool<+1>;
+using DeflateTool = SwellTool<-1>;
 
-    const float effect = 1.f - dist / triBrusher.patchSize;
-    return std::make_pair<bool, float>(dist <= triBrusher.patchSize, effect +0); // duh, +0 to make r-value
+struct HandleTool
+{
+    void Effects(const triID_type* tris, uint n, float* effects_out) { patchFalloff.Effects( tris, n, effects_out ); }
+    void Paint(triID_type triID, float patchEffect, float handleEffect)
+    {
+        MODEL.BrushPos( triID, MODEL.normTris[triID], .01f * handleEffect * patchEffect );
+        normalBrusher.Continue( triID );
+    }
 };
 
+static ColorTool colorTool;
+static InflateTool inflateTool;
+static DeflateTool deflateTool;
+static HandleTool handleTool;
+
 /////////////////
 
 void AppDialog( char d )
@@ -316,8 +342,14 @@ void AppRenderToFile()
 #if defined(ENABLE_SAVE_MODEL)
     message += " and 3D model files";
 
-    MODEL.SavePLY( filename.c_str());
-    MODEL.SaveSTL( filename.c_str());
+    // written from a snapshot in the background, so sculpting can continue
+    {
+        auto snap = std::make_shared<RSphere::snapshot_type>( MODEL.Snapshot() );
+        AppJobs::Pool().Background( [snap, filename] () {
+            RSphere::SavePLY( filename.c_str(), *snap );
+            RSphere::SaveSTL( filename.c_str(), *snap );
+        } );
+    }
 #endif // ENABLE_SAVE_MODEL
 
     message.append(" with name ");
@@ -363,7 +395,6 @@ void AppRenderToFile()
                 posLight_ = quat * posLight_ * glm::conjugate( quat );
                 mxView_ = glm::lookAt( posCamera_, posOrigin, axisUp_ );
             },
-            MODEL.colorVerts,
             nFrames, float(nFrames) / 4.f // 4 secs
         );
 
@@ -377,6 +408,55 @@ void AppRenderToFile()
     dialogStack.back()->Bind(platWidth, platHeight);
 };
 
+// rebuild the model at a new resolution, rebinding everything sized by it
+void AppResizeModel(uint divisions)
+{
+    normalBrusher.Release();
+    triBrusher.Release();
+    MODEL.Release();
+
+    RSphere::SetDivisions( divisions );
+    MODEL.posVerts.clear(); // Bind() resets when empty
+    MODEL.Bind();
+    MODEL.CalibrateUploads(); // chicklet size depends upon model size
+
+    triBrusher.Bind(&MODEL.Picker(), &MODEL);
+    normalBrusher.Bind(&MODEL);
+    normalBrusher.ReStrokeObject();
+
+    AppLog::Info(__FILENAME__, "model %u divisions, %zu tris", MODEL.GetDivisions(), MODEL.indTriVerts.size());
+}
+
+// the tool's paint stage, and normals when it moves verts
+void AppStrokeStages()
+{
+    auto fnBacklog = [] () { return triBrusher.Backlog(); };
+    switch( toolMode )
+    {
+        case ColorMode:
+            scheduler.Run( AppScheduler::PaintStage, [] () { triBrusher.Stroke( colorTool, kStrokeBatch ); }, fnBacklog );
+            break;
+        case InflateMode:
+            scheduler.Run( AppScheduler::PaintStage, [] () { triBrusher.Stroke( inflateTool, kStrokeBatch ); }, fnBacklog );
+            break;
+        case DeflateMode:
+            scheduler.Run( AppScheduler::PaintStage, [] () { triBrusher.Stroke( deflateTool, kStrokeBatch ); }, fnBacklog );
+            break;
+        case HandleMode:
+            scheduler.Run( AppScheduler::PaintStage, [] () { triBrusher.Stroke_handled( handleTool, kStrokeBatch ); },
+                           [] () { return triBrusher.HandleBacklog(); } );
+            break;
+        default:;
+    }
+
+    if( toolMode != ColorMode )
+    {
+        scheduler.Run( AppScheduler::NormalStage,
+                       [] () { normalBrusher.Stroke( kStrokeBatch ); },
+                       [] () { return normalBrusher.Backlog(); } );
+    }
+}
+
 //////////////////////////////
 
 void AppLogic(uint32_t deltaMSec)
@@ -389,11 +469,43 @@ void AppLogic(uint32_t deltaMSec)
     // anything fresh toggles the dialog
     if(keyboard.Check( 'w', AppKeyboard::Fresh )) colorPicker.visible = !colorPicker.visible;
 
-    if( keyboard.Check( 'Z', AppKeyboard::Fresh ) ) { MODEL.Reset(); MODEL.UpdateAllStates(); MODEL.rubus.Reset(); cameraReset(); }
-    if( keyboard.Check( 0x08, AppKeyboard::Fresh ) ) { MODEL.Reset(true); MODEL.UpdateAllStates(); MODEL.rubus.Reset(); }
+    if( keyboard.Check( 'Z', AppKeyboard::Fresh ) ) { MODEL.Reset(); MODEL.UpdateAllStates(); MODEL.ResetPicker(); cameraReset(); }
+    if( keyboard.Check( 0x08, AppKeyboard::Fresh ) ) { MODEL.Undo(); }
+    if( keyboard.Check( 'Y', AppKeyboard::Fresh ) ) { MODEL.Redo(); } // todo: add ui button
 
     if( keyboard.Check( 'B', AppKeyboard::Fresh ) ) { backColor = paintColor; } // todo: add ui button
 
+    // model resolution, resets the model. todo: add ui button
+    if( keyboard.Check( '[', AppKeyboard::Fresh ) ) { AppResizeModel( MODEL.GetDivisions() / 2 ); cameraReset(); }
+    if( keyboard.Check( ']', AppKeyboard::Fresh ) ) { AppResizeModel( MODEL.GetDivisions() * 2 ); cameraReset(); }
+
+    // toggle separate/interleaved vertex buffers, keeps the model. todo: add ui button
+    if( keyboard.Check( 'V', AppKeyboard::Fresh ) )
+    {
+        MODEL.Release();
+        MODEL.storage = MODEL.storage == RSphere::SeparateStorage ? RSphere::InterleavedStorage : RSphere::SeparateStorage;
+        MODEL.Bind();
+    }
+
+    // toggle lat/long and cube map picking bins, keeps the model. todo: add ui button
+    if( keyboard.Check( 'G', AppKeyboard::Fresh ) )
+    {
+        MODEL.rubus.binning = MODEL.rubus.binning == MODEL.rubus.CubeBinning ? MODEL.rubus.LatLongBinning : MODEL.rubus.CubeBinning;
+        if( MODEL.picking == RSphere::RubusPicking ) MODEL.rubus.Reset();
+    }
+
+    // cycle rubus, bvh and id buffer picking, to compare them on real strokes. todo: add ui button
+    if( keyboard.Check( 'P', AppKeyboard::Fresh ) )
+    {
+        if( MODEL.picking == RSphere::RubusPicking ) MODEL.SetPicking( RSphere::BvhPicking );
+        else if( MODEL.picking == RSphere::BvhPicking ) MODEL.SetPicking( RSphere::BufferPicking );
+        else MODEL.SetPicking( RSphere::RubusPicking );
+        triBrusher.Bind(&MODEL.Picker(), &MODEL);
+    }
+
+    // re-time the upload strategies on this driver. todo: add ui button
+    if( keyboard.Check( 'U', AppKeyboard::Fresh ) ) { MODEL.CalibrateUploads(); }
+
     /////////////////// modal text dialogs
 
     if(keyboard.activekeys.size() > 0)
@@ -479,6 +591,8 @@ void AppLogic(uint32_t deltaMSec)
         }
     }
 
+    MODEL.idBuffer.SetView( mxView, mxProj, boxViewport ); // rasterized again on the next pick, when changed
+
     /////////////////// apply a modelling tool
 
     if( keyboard.Check( 't', AppKeyboard::Fresh )) { toolMode = HandleMode; }
@@ -497,22 +611,27 @@ void AppLogic(uint32_t deltaMSec)
             if( toolType == SmallTool )     patchSize = 3.1415f / 8; // radians
             else if( toolType == BigTool )  patchSize = 3.1415f / 4; // radians
 
-            triBrusher.Start( touch[0].pos, posCamera, &fnProject, &fnUnproject, &fnPaintEffector, patchSize );
+            triBrusher.Start( touch[0].pos, posCamera, &fnProject, &fnUnproject, patchFalloff, patchSize );
 
-            MODEL.Backup();
+            MODEL.StrokeBegin();
             std::generate( MODEL.normEffectVerts.begin(), MODEL.normEffectVerts.end(), []() { return 0.f; } );
         }
         else // if( keyboard.Check( tokenStroke, AppKeyboard::Release ))
         {
+            // paint the tail the frames haven't got to, so it's journaled, but only for so long
+            scheduler.BeginDrain( kReleaseSec );
+            AppStrokeStages();
+            scheduler.EndDrain();
+
             triBrusher.Stop(); // stop on release as slow hardware causes problems
+            MODEL.StrokeCommit();
 
-            // detailed normal adjustment...
+            // detailed normal adjustment, over just the stroked region...
             if( toolMode != ColorMode )
             {
-                normalBrusher.ReStrokeObject();
-                MODEL.rubus.Reset();
                 MODEL.UpdatePosFinalize();
                 MODEL.UpdateNormalFinalize();
+                normalBrusher.Stop(); // the finalize covered what it hadn't got to
             } else {
                 MODEL.UpdateColorFinalize();
             }
@@ -525,29 +644,17 @@ void AppLogic(uint32_t deltaMSec)
 
     if( keyboard.Check( tokenStroke, AppKeyboard::Release ) == false ) // anything other than released
     {
-        switch( toolMode )
-        {
-            case ColorMode:
-                triBrusher.Stroke( fnPaintColor, kStrokeTune );
-                MODEL.UpdateColorTick();
-                break;
-            case InflateMode:
-                triBrusher.Stroke( fnPaintInflate, kStrokeTune );
-                normalBrusher.Stroke( kStrokeTune ); // rough normal asjustment...
-                MODEL.UpdatePosTick();
-                break;
-            case DeflateMode:
-                triBrusher.Stroke( fnPaintDeflate, kStrokeTune );
-                normalBrusher.Stroke( kStrokeTune ); // rough normal asjustment...
-                MODEL.UpdatePosTick();
-                break;
-            case HandleMode:
-                triBrusher.Stroke_handled( fnPaintHandle, kStrokeTune );
-                normalBrusher.Stroke( kStrokeTune ); // rough normal asjustment...
-                MODEL.UpdatePosTick();
-                break;
-            default:;
-        }
+        AppStrokeStages();
+
+        // a tick writes the next copy of each stream, so another this frame would write the one just drawn
+        const uint uploads = toolMode == ColorMode ? RSphere::ColorUpload : RSphere::PosUpload | RSphere::NormalUpload;
+        scheduler.Run( AppScheduler::UploadStage,
+                       [] () {
+                           if( toolMode == ColorMode ) MODEL.UpdateColorTick();
+                           else { MODEL.UpdatePosTick(); MODEL.UpdateNormalTick(); }
+                       },
+                       [=] () { return MODEL.UploadBacklog( uploads ); },
+                       1 );
     }
 
     /////////////////// debug options
@@ -735,7 +842,7 @@ void AppEvent(const AppPlatform::Event &event)
                                     auto posCursor = fnUnproject( touch[0].pos );
                                     auto incidentVec = glm::normalize( posCursor - posCamera );
                                     trisearch_type cxt;
-                                    MODEL.rubus.IdentifyTri( cxt, posCamera, incidentVec );
+                                    MODEL.Picker().IdentifyTri( cxt, posCamera, incidentVec );
                                     if( cxt.collisionTri == TriIDEnd )
                                     {
                                         triBrusher.Stop(); // review: put logic in start()?
@@ -857,7 +964,8 @@ void app_rebind()
     cursor[0].Bind(std::min(platWidth, platHeight));
     cursor[1].Bind(std::min(platWidth, platHeight));
     sphere.Bind();
-    triBrusher.Bind(&MODEL.rubus, &MODEL);
+    if( !sphere.uploadCalibrated ) sphere.CalibrateUploads(); // once, the driver won't change
+    triBrusher.Bind(&MODEL.Picker(), &MODEL);
     normalBrusher.Bind(&MODEL);
     normalBrusher.ReStrokeObject(); // right after binding
 
@@ -931,6 +1039,8 @@ void app_main()
         if(appQuit) break; // when told to quit, no tickie-tickie!
         if(appPause) continue; // keep doing important stuff
 
+        scheduler.BeginFrame( float( platform.frameTargetMSec ) / 1000.f ); // the frame's work starts here
+
         // update cursor new positions
         cursor[0].Update(touch[0].pos, touch[0].active);
         cursor[1].Update(touch[1].pos, touch[1].active);
@@ -948,6 +1058,7 @@ void app_main()
         uiInactiveElapsedMSec = uiActive ? 0 : uiInactiveElapsedMSec + platform.deltaMSec;
 
         AppRender();
+        MODEL.uploadStats.EndFrame();
 
         notification.Tick(platform.deltaMSec);
         if( notification.triggered )
@@ -955,13 +1066,17 @@ void app_main()
 #ifdef DEBUG
             float fps = 1 / platform.deltaSecAvg;
             static float fps_ = 1;
-            bool update = (MODEL.bytesUpdated > 0) | (std::abs(fps - fps_) > 1);
+            bool update = (MODEL.uploadStats.bytesUpdated > 0) | (std::abs(fps - fps_) > 1);
             if( update )
             {
-                auto bytesPerSec = float(MODEL.bytesUpdated) / (float(notification.interval) / float(1000));
-                AppLog::Info( __FILENAME__, "platform %f fps, %8.2f kBps", fps, bytesPerSec / float(1000) );
+                auto bytesPerSec = float(MODEL.uploadStats.bytesUpdated) / (float(notification.interval) / float(1000));
+                AppLog::Info( __FILENAME__, "platform %f fps, %8.2f kBps, last frame %u B in %u calls",
+                    fps, bytesPerSec / float(1000), MODEL.uploadStats.lastBytes, MODEL.uploadStats.lastCalls );
+                AppLog::Info( __FILENAME__, "brush backlog: paint %zu, normals %zu, upload %zu",
+                    scheduler.backlogs[ AppScheduler::PaintStage ], scheduler.backlogs[ AppScheduler::NormalStage ],
+                    scheduler.backlogs[ AppScheduler::UploadStage ] );
                 fps_ = fps;
-                MODEL.bytesUpdated = 0;
+                MODEL.uploadStats.bytesUpdated = 0;
             }
 #endif // DEBUG
         }
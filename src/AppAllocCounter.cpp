@@ -0,0 +1,39 @@
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <cstdlib>
+#include <new>
+#include <atomic>
+
+#include "AppAllocCounter.hpp"
+
+#ifdef DEBUG
+
+static std::atomic<size_t> allocations( 0 );
+
+// the other forms of new and delete are built on these two
+void* operator new(size_t bytes)
+{
+    allocations.fetch_add( 1, std::memory_order_relaxed );
+    void* p = malloc( bytes ? bytes : 1 );
+    if( !p ) abort(); // out of memory is fatal here, with or without exceptions
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free( p );
+}
+
+size_t AppAllocCounter::Allocations()
+{
+    return allocations.load( std::memory_order_relaxed );
+}
+
+#else // DEBUG
+
+size_t AppAllocCounter::Allocations()
+{
+    return 0;
+}
+
+#endif // DEBUG
@@ -0,0 +1,15 @@
+#ifndef _APPALLOCCOUNTER_HPP_
+#define _APPALLOCCOUNTER_HPP_
+
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <unistd.h>
+
+// Counts heap allocations, so a test can hold code to not allocating.
+// DEBUG builds replace the global operator new to count them. Other builds count nothing.
+struct AppAllocCounter
+{
+    static size_t Allocations(); // since startup, on all threads
+};
+
+#endif //_APPALLOCCOUNTER_HPP_
@@ -0,0 +1,71 @@
+#ifndef _APPCOWARRAY_HPP_
+#define _APPCOWARRAY_HPP_
+
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <unistd.h>
+#include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+
+// An array kept in fixed-size reference-counted pages. Copies share pages, so a copy is a
+// snapshot costing one pointer per page, and a page is duplicated only when written while shared.
+// Reads are through operator[], writes through Write() so that reads never duplicate.
+template<class T, unsigned PageBits = 10>
+struct AppCowArray
+{
+    static const size_t PageItems = size_t(1) << PageBits;
+    static const size_t PageMask = PageItems - 1;
+
+    using value_type = T;
+    using page_type = std::array<T, PageItems>;
+
+    std::vector<std::shared_ptr<page_type>> pages;
+    size_t count = 0;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    void clear() { pages.clear(); count = 0; }
+
+    void assign(size_t n, const T& value)
+    {
+        Repage( n );
+        for( auto& p : pages ) p->fill( value );
+    }
+    void assign(const std::vector<T>& vec)
+    {
+        Repage( vec.size() );
+        for( size_t p = 0; p < pages.size(); p++ )
+        {
+            const size_t first = p << PageBits;
+            std::copy( vec.begin() + first, vec.begin() + std::min( count, first + PageItems ), pages[ p ]->begin() );
+        }
+    }
+
+    const T& operator[](size_t i) const { return (*pages[ i >> PageBits ])[ i & PageMask ]; }
+
+    // sized for n, keeping the pages no snapshot holds. contents are left as they were
+    void Repage(size_t n)
+    {
+        count = n;
+        pages.resize( (n + PageMask) >> PageBits );
+        for( auto& p : pages ) if( !p || p.use_count() > 1 ) p = std::make_shared<page_type>();
+    }
+
+    T& Write(size_t i)
+    {
+        auto& p = pages[ i >> PageBits ];
+        if( p.use_count() > 1 ) p = std::make_shared<page_type>( *p ); // someone holds a snapshot
+        return (*p)[ i & PageMask ];
+    }
+
+    // contiguous items from i to the end of its page
+    const T* Span(size_t i, size_t& items) const
+    {
+        items = std::min( count, ( i | PageMask ) + 1 ) - i;
+        return &(*this)[ i ];
+    }
+};
+
+#endif //_APPCOWARRAY_HPP_
@@ -0,0 +1,206 @@
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+
+#include "AppJobs.hpp"
+#include "AppLog.hpp"
+
+#define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
+
+thread_local uint AppJobs::tlsQueue = 0;
+
+AppJobs& AppJobs::Pool()
+{
+    static AppJobs pool( std::max( 1u, std::thread::hardware_concurrency() ) - 1 );
+    return pool;
+}
+
+AppJobs::AppJobs(uint workers) : quit(false), queued(0)
+{
+    for( uint i = 0; i <= workers; i++ ) queues.emplace_back( new queue_type );
+    for( uint i = 1; i <= workers; i++ ) threads.emplace_back( &AppJobs::Work, this, i );
+    backgroundThread = std::thread( &AppJobs::BackgroundWork, this );
+
+    AppLog::Info(__FILENAME__, "jobs %u threads\n", Threads());
+}
+
+AppJobs::~AppJobs()
+{
+    while( TryRun( tlsQueue ) ) {}
+
+    quit = true;
+    {
+        std::lock_guard<std::mutex> lock( backgroundMutex );
+        backgroundWake.notify_all();
+    }
+    backgroundThread.join(); // after its queue drains, and its jobs can still submit to the workers
+    {
+        std::lock_guard<std::mutex> lock( sleepMutex );
+        wake.notify_all();
+    }
+    for( auto& t : threads ) t.join();
+}
+
+void AppJobs::Submit(job_type job, counter_type* pCounter)
+{
+    if( threads.empty() ) { job(); return; } // nobody else would run it
+
+    entry_type entry;
+    entry.job = std::move( job );
+    entry.pCounter = pCounter;
+    Push( std::move( entry ) );
+}
+
+void AppJobs::Background(job_type job, counter_type* pCounter)
+{
+    if( pCounter ) pCounter->pending++;
+
+    entry_type entry;
+    entry.job = std::move( job );
+    entry.pCounter = pCounter;
+    {
+        std::lock_guard<std::mutex> lock( backgroundMutex );
+        background.push_back( std::move( entry ) );
+    }
+    backgroundWake.notify_one();
+}
+
+void AppJobs::Push(entry_type&& entry)
+{
+    if( entry.pCounter ) entry.pCounter->pending++;
+
+    queue_type& q = *queues[ tlsQueue ];
+    {
+        std::lock_guard<std::mutex> lock( q.mutex );
+        q.jobs.push_back( std::move( entry ) );
+    }
+    queued++;
+
+    {
+        std::lock_guard<std::mutex> lock( sleepMutex );
+        wake.notify_one();
+    }
+}
+
+// runs one job: the newest of our own, else the oldest of someone else's
+bool AppJobs::TryRun(uint self)
+{
+    entry_type entry;
+    bool found = false;
+
+    for( uint i = 0; i < queues.size() && !found; i++ )
+    {
+        const uint victim = ( self + i ) % uint( queues.size() );
+        queue_type& q = *queues[ victim ];
+        std::lock_guard<std::mutex> lock( q.mutex );
+        if( q.jobs.empty() ) continue;
+        if( i == 0 ) { entry = std::move( q.jobs.back() ); q.jobs.pop_back(); }
+        else { entry = std::move( q.jobs.front() ); q.jobs.pop_front(); }
+        found = true;
+    }
+    if( !found ) return false;
+
+    queued--;
+    if( entry.pRange ) ( *entry.pRange )( entry.first, entry.end );
+    else entry.job();
+    if( entry.pCounter ) entry.pCounter->pending--;
+    return true;
+}
+
+void AppJobs::Work(uint self)
+{
+    tlsQueue = self;
+    while( !quit )
+    {
+        if( TryRun( self ) ) continue;
+
+        std::unique_lock<std::mutex> lock( sleepMutex );
+        wake.wait_for( lock, std::chrono::milliseconds( 10 ), [this] () { return quit || queued > 0; } );
+    }
+}
+
+// runs the background jobs in order, then finishes them all before quitting
+void AppJobs::BackgroundWork()
+{
+    std::unique_lock<std::mutex> lock( backgroundMutex );
+    while( true )
+    {
+        backgroundWake.wait( lock, [this] () { return quit || !background.empty(); } );
+        if( background.empty() ) return;
+
+        entry_type entry = std::move( background.front() );
+        background.pop_front();
+        lock.unlock();
+        entry.job();
+        if( entry.pCounter ) entry.pCounter->pending--;
+        lock.lock();
+    }
+}
+
+void AppJobs::Wait(counter_type& counter)
+{
+    while( counter.pending > 0 )
+        if( !TryRun( tlsQueue ) ) std::this_thread::yield();
+}
+
+void AppJobs::ParallelFor(size_t begin, size_t end, size_t grain, const range_type& fn)
+{
+    if( begin >= end ) return;
+    grain = std::max<size_t>( 1, grain );
+
+    if( threads.empty() || end - begin <= grain )
+    {
+        for( size_t first = begin; first < end; first += grain ) fn( first, std::min( end, first + grain ) );
+        return;
+    }
+
+    counter_type counter;
+    for( size_t first = begin; first < end; first += grain )
+    {
+        entry_type entry;
+        entry.pRange = &fn;
+        entry.first = first;
+        entry.end = std::min( end, first + grain );
+        entry.pCounter = &counter;
+        Push( std::move( entry ) );
+    }
+    Wait( counter );
+}
+
+uint AppJobs::graph_type::Add(job_type job, std::initializer_list<uint> after)
+{
+    const uint id = uint( nodes.size() );
+    nodes.emplace_back( job );
+    for( auto a : after )
+    {
+        assert( a < id );
+        nodes[ a ].successors.push_back( id );
+        nodes.back().predecessors++;
+    }
+    return id;
+}
+
+void AppJobs::Run(graph_type& graph)
+{
+    counter_type counter;
+
+    // a node's job, then any successors it was the last to release
+    std::function<void(uint)> fnNode = [&] (uint id) {
+        auto& node = graph.nodes[ id ];
+        node.job();
+        for( auto s : node.successors )
+            if( --graph.nodes[ s ].waiting == 0 )
+                Submit( [&fnNode, s] () { fnNode( s ); }, &counter );
+    };
+
+    for( auto& node : graph.nodes ) node.waiting = node.predecessors;
+    for( uint id = 0; id < graph.nodes.size(); id++ )
+        if( graph.nodes[ id ].predecessors == 0 )
+            Submit( [&fnNode, id] () { fnNode( id ); }, &counter );
+    Wait( counter );
+}
@@ -0,0 +1,161 @@
+#ifndef _APPJOBS_HPP_
+#define _APPJOBS_HPP_
+
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <unistd.h>
+#include <vector>
+#include <deque>
+#include <array>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "AppTypes.hpp"
+
+// A small work-stealing thread pool.
+// Each worker pops jobs from the back of its own queue and steals from the front of the others.
+// Threads outside the pool queue into a shared queue, and any thread that waits on a counter
+// runs jobs until the counter drains, so nested submits can't deadlock.
+// Background jobs, like saves and rebuilds, go to a thread of their own that nothing waits on,
+// so they never stall a thread that's waiting, or run in the caller when there are no workers.
+struct AppJobs
+{
+    using job_type = std::function<void()>;
+    using range_type = std::function<void(size_t /* first */, size_t /* end */)>;
+
+    // jobs outstanding, waited on with Wait()
+    struct counter_type
+    {
+        std::atomic<uint> pending;
+        counter_type() : pending(0) {}
+    };
+
+    // jobs run once all of the jobs they follow are done
+    struct graph_type
+    {
+        struct node_type
+        {
+            job_type job;
+            std::vector<uint> successors;
+            uint predecessors = 0;
+            std::atomic<uint> waiting;
+            node_type(job_type j) : job(j), waiting(0) {}
+        };
+        std::deque<node_type> nodes; // stable addresses
+
+        uint Add(job_type job, std::initializer_list<uint> after = {});
+    };
+
+    static AppJobs& Pool(); // hardware concurrency, started on first use
+
+    explicit AppJobs(uint workers);
+    ~AppJobs(); // finishes queued jobs
+
+    uint Threads() const { return uint( threads.size() ) + 1; } // the caller helps
+
+    void Submit(job_type job, counter_type* pCounter = 0); // runs it now when there are no workers
+    void Background(job_type job, counter_type* pCounter = 0); // poll the counter, as Wait() won't run it
+    void Wait(counter_type& counter);
+
+    // calls fn(first, end) over [begin,end) in chunks of grain. chunks don't depend upon the thread
+    // count, so per-chunk partial results reduced in chunk order are deterministic
+    void ParallelFor(size_t begin, size_t end, size_t grain, const range_type& fn);
+    static size_t Chunks(size_t begin, size_t end, size_t grain) { return (end - begin + grain - 1) / grain; }
+
+    void Run(graph_type& graph);
+
+    // sorts chunks in parallel then merges them pairwise, a level at a time.
+    // use a total order for results that don't depend upon the thread count
+    template<class T, class Cmp>
+    void ParallelSort(std::vector<T>& vec, Cmp cmp, size_t grain = 16384)
+    {
+        ParallelFor( 0, vec.size(), grain, [&] (size_t first, size_t end) {
+            std::sort( vec.begin() + first, vec.begin() + end, cmp );
+        } );
+        for( size_t width = grain; width < vec.size(); width *= 2 )
+        {
+            ParallelFor( 0, vec.size(), width * 2, [&] (size_t first, size_t end) {
+                if( first + width < end ) std::inplace_merge( vec.begin() + first, vec.begin() + first + width, vec.begin() + end, cmp );
+            } );
+        }
+    }
+
+    // stable LSD radix sort on the low keyBits of key(item), a byte per pass. chunks count and
+    // scatter in parallel, in chunk order, so equal keys keep their order whatever the thread count.
+    // pScratch can be kept by the caller between sorts, to save allocating it
+    template<class T, class KeyFn>
+    void ParallelRadixSort(std::vector<T>& vec, KeyFn key, unsigned keyBits, size_t grain = 16384, std::vector<T>* pScratch = 0)
+    {
+        std::vector<T> scratch;
+        std::vector<T>& sorted = pScratch ? *pScratch : scratch;
+        sorted.resize( vec.size() );
+        std::vector<std::array<size_t, 256>> starts( Chunks( 0, vec.size(), grain ) );
+        for( unsigned shift = 0; shift < keyBits; shift += 8 )
+        {
+            ParallelFor( 0, vec.size(), grain, [&] (size_t first, size_t end) {
+                auto& counts = starts[ first / grain ];
+                counts.fill( 0 );
+                for( size_t i = first; i < end; i++ ) counts[ ( key( vec[ i ] ) >> shift ) & 0xFF ]++;
+            } );
+
+            // each chunk's start in each bucket, buckets then chunks
+            size_t sum = 0;
+            bool oneBucket = false;
+            for( uint b = 0; b < 256; b++ )
+            {
+                const size_t bucket = sum;
+                for( auto& counts : starts ) { const size_t n = counts[ b ]; counts[ b ] = sum; sum += n; }
+                oneBucket |= sum - bucket == vec.size();
+            }
+            if( oneBucket ) continue; // this byte is the same everywhere
+
+            ParallelFor( 0, vec.size(), grain, [&] (size_t first, size_t end) {
+                auto& next = starts[ first / grain ];
+                for( size_t i = first; i < end; i++ ) sorted[ next[ ( key( vec[ i ] ) >> shift ) & 0xFF ]++ ] = vec[ i ];
+            } );
+            vec.swap( sorted );
+        }
+    }
+
+private:
+    // a job, or a chunk of a ParallelFor() which refers to its range so queueing it doesn't allocate
+    struct entry_type
+    {
+        job_type job;
+        const range_type* pRange = 0;
+        size_t first = 0, end = 0;
+        counter_type* pCounter = 0;
+    };
+
+    struct queue_type
+    {
+        std::mutex mutex;
+        ring_tmpl<entry_type> jobs; // keeps its slots, so steady submits don't allocate
+    };
+
+    std::vector<std::unique_ptr<queue_type>> queues; // [0] is for threads outside the pool
+    std::vector<std::thread> threads;
+    std::atomic<bool> quit;
+    std::atomic<uint> queued;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    ring_tmpl<entry_type> background;
+    std::mutex backgroundMutex;
+    std::condition_variable backgroundWake;
+    std::thread backgroundThread;
+
+    static thread_local uint tlsQueue; // this thread's queue
+
+    void Push(entry_type&& entry);
+    bool TryRun(uint self);
+    void Work(uint self);
+    void BackgroundWork();
+};
+
+#endif //_APPJOBS_HPP_
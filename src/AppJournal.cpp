@@ -0,0 +1,154 @@
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+#include <numeric>
+
+#include "AppJournal.hpp"
+
+const uint32_t AppJournal::NoSlot;
+
+size_t AppJournal::delta_type::Bytes() const
+{
+    size_t bytes = sizeof(delta_type);
+    for( uint c = 0; c < ChannelCount; c++ )
+        bytes += ids[ c ].capacity() + values[ c ].capacity() * sizeof(glm::vec3);
+    return bytes;
+}
+
+void AppJournal::Resize(size_t verts)
+{
+    Clear();
+    for( uint c = 0; c < ChannelCount; c++ ) slot[ c ].assign( verts, NoSlot );
+}
+
+void AppJournal::Clear()
+{
+    for( uint c = 0; c < ChannelCount; c++ )
+    {
+        for( auto v : pendingIDs[ c ] ) slot[ c ][ v ] = NoSlot;
+        pendingIDs[ c ].clear();
+        pendingValues[ c ].clear();
+    }
+    undos.clear();
+    redos.clear();
+    historyBytes = 0;
+    recording = false;
+}
+
+void AppJournal::Begin()
+{
+    if( recording ) Commit();
+    recording = true;
+}
+
+void AppJournal::Commit()
+{
+    if( !recording ) return;
+    recording = false;
+
+    size_t pending = 0;
+    for( uint c = 0; c < ChannelCount; c++ ) pending += pendingIDs[ c ].size();
+    if( pending == 0 ) return; // eg a stroke that missed the model
+
+    delta_type delta;
+    std::vector<uint32_t> order;
+    for( uint c = 0; c < ChannelCount; c++ )
+    {
+        auto& ids = pendingIDs[ c ];
+        auto& values = pendingValues[ c ];
+
+        // ascending ids make small gaps, which make short varints
+        order.resize( ids.size() );
+        std::iota( order.begin(), order.end(), 0 );
+        std::sort( order.begin(), order.end(), [&] (uint32_t a, uint32_t b) { return ids[ a ] < ids[ b ]; } );
+
+        delta.ids[ c ].reserve( ids.size() * 2 );
+        delta.values[ c ].reserve( ids.size() );
+        vertID_type prev = 0;
+        for( auto i : order )
+        {
+            auto gap = ids[ i ] - prev;
+            prev = ids[ i ];
+            do {
+                uint8_t byte = uint8_t( gap & 0x7F );
+                gap >>= 7;
+                delta.ids[ c ].push_back( gap ? uint8_t( byte | 0x80 ) : byte );
+            } while( gap );
+            delta.values[ c ].push_back( values[ i ] );
+        }
+        delta.ids[ c ].shrink_to_fit();
+
+        for( auto v : ids ) slot[ c ][ v ] = NoSlot;
+        ids.clear();
+        values.clear();
+    }
+
+    for( auto& r : redos ) historyBytes -= r.Bytes();
+    redos.clear();
+
+    historyBytes += delta.Bytes();
+    undos.push_back( std::move( delta ) );
+    Trim();
+}
+
+void AppJournal::Trim()
+{
+    while( historyBytes > budgetBytes && undos.size() > 1 )
+    {
+        historyBytes -= undos.front().Bytes();
+        undos.pop_front();
+    }
+}
+
+void AppJournal::Apply(delta_type& delta, arrays_type arrays, touch_type& fnTouched)
+{
+    for( uint c = 0; c < ChannelCount; c++ )
+    {
+        auto& vec = *arrays[ c ];
+        const auto& ids = delta.ids[ c ];
+        auto& values = delta.values[ c ];
+
+        size_t b = 0;
+        vertID_type v = 0;
+        for( auto& value : values )
+        {
+            vertID_type gap = 0;
+            uint shift = 0;
+            while( true )
+            {
+                const uint8_t byte = ids[ b++ ];
+                gap |= vertID_type( byte & 0x7F ) << shift;
+                if( !(byte & 0x80) ) break;
+                shift += 7;
+            }
+            v += gap;
+            assert( v < vec.size() );
+            std::swap( value, vec.Write( v ) );
+            fnTouched( channel_type( c ), v );
+        }
+    }
+}
+
+bool AppJournal::Undo(arrays_type arrays, touch_type fnTouched)
+{
+    Commit();
+    if( undos.size() == 0 ) return false;
+
+    Apply( undos.back(), arrays, fnTouched );
+    redos.push_back( std::move( undos.back() ) );
+    undos.pop_back();
+    return true;
+}
+
+bool AppJournal::Redo(arrays_type arrays, touch_type fnTouched)
+{
+    if( recording || redos.size() == 0 ) return false;
+
+    Apply( redos.back(), arrays, fnTouched );
+    undos.push_back( std::move( redos.back() ) );
+    redos.pop_back();
+    return true;
+}
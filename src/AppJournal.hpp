@@ -0,0 +1,76 @@
+#ifndef _APPJOURNAL_HPP_
+#define _APPJOURNAL_HPP_
+
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <unistd.h>
+#include <vector>
+#include <deque>
+#include <functional>
+
+#include "AppTypes.hpp"
+
+// Sparse per-stroke undo/redo history of vec3 vertex attributes.
+// A stroke records the value of each vertex it touches before the first write. Undo swaps
+// those values back into the model, leaving the swapped-out values in the record for redo.
+struct AppJournal
+{
+    enum channel_type { PosChannel, ColorChannel, ChannelCount };
+
+    // one stroke: vertIDs ascending as varint gaps, and the other state of each vertex
+    struct delta_type
+    {
+        std::vector<uint8_t> ids[ ChannelCount ];
+        std::vector<glm::vec3> values[ ChannelCount ];
+
+        size_t Bytes() const;
+    };
+
+    using arrays_type = vertarray_type*[ ChannelCount ];
+    using touch_type = std::function<void(channel_type, vertID_type)>;
+
+    size_t budgetBytes = size_t(16) << 20; // oldest strokes are dropped over this, but never the last one
+    size_t historyBytes = 0;
+
+    std::deque<delta_type> undos, redos;
+
+    // the stroke being recorded
+    static const uint32_t NoSlot = ~uint32_t(0);
+    std::vector<uint32_t> slot[ ChannelCount ]; // vertID to pending index, or NoSlot
+    std::vector<vertID_type> pendingIDs[ ChannelCount ];
+    std::vector<glm::vec3> pendingValues[ ChannelCount ];
+    bool recording = false;
+
+    void Resize(size_t verts); // clears history
+    void Clear();
+
+    void Begin();
+    void Commit();
+
+    void Record(channel_type c, vertID_type v, const glm::vec3& value)
+    {
+        if( !recording || slot[ c ][ v ] != NoSlot ) return;
+        slot[ c ][ v ] = uint32_t( pendingIDs[ c ].size() );
+        pendingIDs[ c ].push_back( v );
+        pendingValues[ c ].push_back( value );
+    }
+
+    // the value at the start of this stroke, when it has been changed
+    const glm::vec3* Original(channel_type c, vertID_type v) const
+    {
+        return ( recording && slot[ c ][ v ] != NoSlot ) ? &pendingValues[ c ][ slot[ c ][ v ] ] : 0;
+    }
+
+    bool CanUndo() const { return undos.size() > 0 || recording; }
+    bool CanRedo() const { return redos.size() > 0; }
+
+    // swaps values in place and reports each vertex changed
+    bool Undo(arrays_type arrays, touch_type fnTouched);
+    bool Redo(arrays_type arrays, touch_type fnTouched);
+
+private:
+    static void Apply(delta_type& delta, arrays_type arrays, touch_type& fnTouched);
+    void Trim();
+};
+
+#endif //_APPJOURNAL_HPP_
@@ -15,89 +15,115 @@
 #include "GL9.hpp"
 
 #include "AppNormalBrusher.hpp"
+#include "RSphere.hpp"
+#include "AppJobs.hpp"
+#include "TriTools.hpp"
 
-void AppNormalBrusher::Bind(IRenormalizable* p)
+template<class Mesh>
+void AppNormalBrusher<Mesh>::Bind(Mesh* p)
 {
     pRenormalizable = p;
+    dirtyVerts.Resize( p->GetPosVerts().size() );
+    batchVerts.Resize( p->GetPosVerts().size() );
+    renormTris.Resize( p->GetNormTris().size() );
+    renormVerts.Resize( p->GetPosVerts().size() );
 }
-void AppNormalBrusher::Release()
+template<class Mesh>
+void AppNormalBrusher<Mesh>::Release()
 {
     pRenormalizable = 0;
 }
 
-void AppNormalBrusher::Start()
+template<class Mesh>
+void AppNormalBrusher<Mesh>::Start()
 {
     lastTriangle = TriIDEnd;
 }
 
-void AppNormalBrusher::Stop()
+template<class Mesh>
+void AppNormalBrusher<Mesh>::Stop()
 {
-    //deqSegments.clear(); // check. might cause problems if allowed to term early
+    dirtyVerts.Clear(); // the model finalizes whatever is left
 }
 
-void AppNormalBrusher::Continue(triID_type triID)
+template<class Mesh>
+void AppNormalBrusher<Mesh>::Continue(triID_type triID)
 {
-    deqSegments.push_back( triID );
+    auto vertInd = pRenormalizable->TriVertInd( triID );
+    dirtyVerts.Set( vertInd.x );
+    dirtyVerts.Set( vertInd.y );
+    dirtyVerts.Set( vertInd.z );
 }
 
-void AppNormalBrusher::Stroke(uint maxiter)
+template<class Mesh>
+void AppNormalBrusher<Mesh>::Stroke(uint maxiter)
 {
-    if(deqSegments.size() == 0) return; // fast fail
+    if(!dirtyVerts.Any()) return; // fast fail
     if(pRenormalizable->HasDegenerates()) return; // TODO degenerate case
 
-    const glm::vec3 zero( 0.f );
-    const glm::vec3 half( 1.f / 2.f );
-    const glm::vec3 third( 1.f / 3.f );
-    const float halfDeg( float(M_PI) / 360.f );
-
-    std::vector<glm::vec3>& normTris = pRenormalizable->GetNormTris();
-    std::vector<glm::vec3>& normVerts = pRenormalizable->GetNormVerts();
-    std::vector<glm::vec3> const & posVerts = pRenormalizable->GetPosVerts();
-
-    while(--maxiter)
-    {
-        if(deqSegments.size() == 0) break;
-
-        triID_type triID = deqSegments.front();
-        deqSegments.pop_front();
+    // lowest verts first
+    batchVerts.Clear();
+    uint batch = 0;
+    for( size_t w = dirtyVerts.lo; w < dirtyVerts.hi && batch < maxiter; w++ )
+        for( uint32_t bits = dirtyVerts.words[ w ]; bits && batch < maxiter; bits &= bits - 1, batch++ )
+        {
+            const size_t v = (w << 5) + __builtin_ctz( bits );
+            batchVerts.Set( v );
+            dirtyVerts.Clear( v );
+        }
+    if( batch < maxiter ) dirtyVerts.Clear(); // took them all, so drop the extents too
+    if( batch == 0 ) return;
 
-        /////
+    Renormalize( *pRenormalizable, batchVerts, renormTris, renormVerts );
+}
 
-        auto vertInd = pRenormalizable->TriVertInd( triID );
-        auto triInd = pRenormalizable->TriInd(triID);
-        auto triNormal = glm::triangleNormal( posVerts[ vertInd.x ], posVerts[ vertInd.y ], posVerts[ vertInd.z ] );
-        const float angle = std::acos( glm::dot( normTris[ triInd ], triNormal ) ); // check
+template<class Mesh>
+size_t AppNormalBrusher<Mesh>::Backlog() const
+{
+    if(pRenormalizable->HasDegenerates()) return 0;
+    return dirtyVerts.Count();
+}
 
-        // if above tolerance, continue with neighbours
-        if( !std::isnan(angle) && angle > halfDeg )
-        {
-            normTris[triInd] = triNormal;
-
-            // rough estimate...
-            normVerts[vertInd.x] = (normVerts[vertInd.x] + normTris[triInd]) * half;
-            normVerts[vertInd.y] = (normVerts[vertInd.y] + normTris[triInd]) * half;
-            normVerts[vertInd.z] = (normVerts[vertInd.z] + normTris[triInd]) * half;
-
-            // check neighbours
-            auto others = pRenormalizable->AdjTriInd( triID );
-            if( others.x != TriIDEnd ) deqSegments.push_back( others.x );
-            if( others.y != TriIDEnd ) deqSegments.push_back( others.y );
-            if( others.z != TriIDEnd ) deqSegments.push_back( others.z );
-        }
-    }
+template<class Mesh>
+void AppNormalBrusher<Mesh>::Renormalize(Mesh& r, const dirtybits_type& movedVerts, dirtybits_type& renormTris_out, dirtybits_type& renormVerts_scratch)
+{
+    std::vector<glm::vec3>& normTris = r.GetNormTris();
+    vertarray_type& normVerts = r.GetNormVerts();
+    vertarray_type const & posVerts = r.GetPosVerts();
+    const vertTris_type& vertTris = r.GetVertTris();
+
+    renormTris_out.Clear();
+    movedVerts.ForEach( [&] (size_t v) {
+        for( auto t = vertTris.begin( v ); t != vertTris.end( v ); ++t ) renormTris_out.Set( *t );
+    } );
+
+    renormVerts_scratch.Clear();
+    renormTris_out.ForEach( [&] (size_t t) {
+        auto vertInd = r.TriVertInd( triID_type( t ) );
+        normTris[ r.TriInd( triID_type( t ) ) ] = glm::triangleNormal( posVerts[ vertInd.x ], posVerts[ vertInd.y ], posVerts[ vertInd.z ] );
+        renormVerts_scratch.Set( vertInd.x );
+        renormVerts_scratch.Set( vertInd.y );
+        renormVerts_scratch.Set( vertInd.z );
+    } );
+
+    renormVerts_scratch.ForEach( [&] (size_t v) {
+        glm::vec3 sum( 0.f );
+        for( auto t = vertTris.begin( v ); t != vertTris.end( v ); ++t ) sum += normTris[ r.TriInd( *t ) ];
+        normVerts.Write( v ) = VertNormal( sum );
+        r.UpdateNorm( vertID_type( v ) );
+    } );
 }
 
-void AppNormalBrusher::ReStrokeObject()
+template<class Mesh>
+void AppNormalBrusher<Mesh>::ReStrokeObject()
 {
-    deqSegments.clear();
+    dirtyVerts.Clear();
 
     const glm::vec3 zero( 0.f );
-    const glm::vec3 half( 1.f / 2.f );
-    const glm::vec3 third( 1.f / 3.f );
 
     std::vector<glm::vec3>& normTris = pRenormalizable->GetNormTris();
-    std::vector<glm::vec3>& normVerts = pRenormalizable->GetNormVerts();
-    std::vector<glm::vec3> const & posVerts = pRenormalizable->GetPosVerts();
+    vertarray_type& normVerts = pRenormalizable->GetNormVerts();
+    vertarray_type const & posVerts = pRenormalizable->GetPosVerts();
 
     // clear first, so we can summate
     normVerts.assign( posVerts.size(), zero );
@@ -112,53 +138,43 @@ void AppNormalBrusher::ReStrokeObject()
             if(posVerts[vertInd.x] == posVerts[vertInd.y] || posVerts[vertInd.y] == posVerts[vertInd.z])
             {
                 // clearing here is only redundant when we took a cache loss due to resizing...
-                normVerts[vertInd.x] = normVerts[vertInd.y] = normVerts[vertInd.z] = zero;
+                normVerts.Write( vertInd.x ) = normVerts.Write( vertInd.y ) = normVerts.Write( vertInd.z ) = zero;
                 continue; // degenerate
             }
 
             auto triInd = pRenormalizable->TriInd(triID);
             normTris[ triInd ] = glm::triangleNormal( posVerts[ vertInd.x ], posVerts[ vertInd.y ], posVerts[ vertInd.z ] );
 
-            normVerts[ vertInd.x ] += normTris[ triInd ];
-            normVerts[ vertInd.y ] += normTris[ triInd ];
-            normVerts[ vertInd.z ] += normTris[ triInd ];
+            normVerts.Write( vertInd.x ) += normTris[ triInd ];
+            normVerts.Write( vertInd.y ) += normTris[ triInd ];
+            normVerts.Write( vertInd.z ) += normTris[ triInd ];
         }
 
         // normalize
-        for(triID_type triID = 0; triID < normTris.size(); triID++)
-        {
-            auto vertInd = pRenormalizable->TriVertInd( triID );
-            if(posVerts[vertInd.x] == posVerts[vertInd.y]) {
-                normVerts[ vertInd.x ] *= half;
-                normVerts[ vertInd.y ] *= half;
-            } else if(posVerts[vertInd.y] == posVerts[vertInd.z]) {
-                normVerts[ vertInd.y ] *= half;
-                normVerts[ vertInd.z ] *= half;
-            } else {
-                normVerts[ vertInd.x ] *= third;
-                normVerts[ vertInd.y ] *= third;
-                normVerts[ vertInd.z ] *= third;
-            }
-        }
+        for(vertID_type v = 0; v < normVerts.size(); v++) normVerts.Write( v ) = VertNormal( normVerts[ v ] );
     } else {
-        // summate
-        for(triID_type triID = 0; triID < normTris.size(); triID++)
-        {
-            auto vertInd = pRenormalizable->TriVertInd( triID );
-            auto triInd = pRenormalizable->TriInd(triID);
-            normTris[ triInd ] = glm::triangleNormal( posVerts[ vertInd.x ], posVerts[ vertInd.y ], posVerts[ vertInd.z ] );
-            normVerts[ vertInd.x ] += normTris[ triInd ];
-            normVerts[ vertInd.y ] += normTris[ triInd ];
-            normVerts[ vertInd.z ] += normTris[ triInd ];
-        }
+        AppJobs& jobs = AppJobs::Pool();
 
-        // normalize
-        for(triID_type triID = 0; triID < normTris.size(); triID++)
-        {
-            auto vertInd = pRenormalizable->TriVertInd( triID );
-            normVerts[ vertInd.x ] *= third;
-            normVerts[ vertInd.y ] *= third;
-            normVerts[ vertInd.z ] *= third;
-        }
+        jobs.ParallelFor( 0, normTris.size(), 4096, [&] (size_t first, size_t end) {
+            for(size_t triID = first; triID < end; triID++)
+            {
+                auto vertInd = pRenormalizable->TriVertInd( triID_type( triID ) );
+                auto triInd = pRenormalizable->TriInd( triID_type( triID ) );
+                normTris[ triInd ] = glm::triangleNormal( posVerts[ vertInd.x ], posVerts[ vertInd.y ], posVerts[ vertInd.z ] );
+            }
+        } );
+
+        // summate, then normalize
+        TriVertSums( posVerts.size(), normTris.size(),
+            [&] (triID_type t) { return pRenormalizable->TriVertInd( t ); },
+            [&] (triID_type t) { return normTris[ pRenormalizable->TriInd( t ) ]; },
+            [&] (vertID_type v, const glm::vec3& sum, uint) {
+                normVerts.Write( v ) = VertNormal( sum );
+            } );
     }
+
+    pRenormalizable->UpdateAllNorms();
 }
+
+template struct AppNormalBrusher<RSphere>;
+template struct AppNormalBrusher<IRenormalizable>;
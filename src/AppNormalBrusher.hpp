@@ -4,27 +4,35 @@
 // Copyright 2025 orthopteroid@gmail.com, MIT License
 
 #include <unistd.h>
-#include <deque>
 
 #include "AppTypes.hpp"
 
-// can renormalize verts and tris for any IRenormalizable class
+// can renormalize verts and tris for any IRenormalizable class. Mesh is the model's own type, so its
+// accessors are inlined into the loops, or IRenormalizable to reach a model through its virtuals.
+// AppNormalBrusher.cpp instantiates those it is built for
+template<class Mesh>
 struct AppNormalBrusher
 {
-    std::deque<triID_type> deqSegments;
+    // verts moved and not yet renormalized, and scratch for Renormalize
+    dirtybits_type dirtyVerts, batchVerts, renormTris, renormVerts;
 
-    IRenormalizable* pRenormalizable = 0;
+    Mesh* pRenormalizable = 0;
     triID_type lastTriangle;
 
-    void Bind(IRenormalizable* p);
+    void Bind(Mesh* p);
     void Release();
 
     void Start();
     void Stop();
     void Continue(triID_type triID);
-    void Stroke(uint maxiter);
+    void Stroke(uint maxiter); // renormalizes around up to maxiter dirty verts
+    size_t Backlog() const; // the dirty verts Stroke() would get to
 
     void ReStrokeObject();
+
+    // recompute the normals of the tris using the moved verts, then of those tris' verts, summed
+    // the same way as ReStrokeObject. leaves the tris renormalized in renormTris_out
+    static void Renormalize(Mesh& r, const dirtybits_type& movedVerts, dirtybits_type& renormTris_out, dirtybits_type& renormVerts_scratch);
 };
 
 #endif //_APPNORMALBRUSHER_HPP_
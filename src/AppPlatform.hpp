@@ -41,6 +41,7 @@ struct AppPlatform
 
     uint32_t deltaMSec = 0;
     float deltaSecAvg = 0.f;
+    uint32_t frameTargetMSec = 33; // the frame time the platform ticks at, set by Bind
 
     void Bind(
         std::function<void(void)> rebindFn_, std::function<void(void)> releaseFn_,
@@ -0,0 +1,19 @@
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <time.h>
+
+#include "AppScheduler.hpp"
+
+double AppScheduler::Now()
+{
+    struct timespec spec;
+    clock_gettime( CLOCK_MONOTONIC, &spec );
+    return double( spec.tv_sec ) + double( spec.tv_nsec ) / 1E+9;
+}
+
+double AppScheduler::Deadline(stage_type stage) const
+{
+    float share = 0;
+    for( int s = 0; s <= stage; s++ ) share += shares[ s ];
+    return double( frameSec * workFraction * share );
+}
@@ -0,0 +1,54 @@
+#ifndef _APPSCHEDULER_HPP_
+#define _APPSCHEDULER_HPP_
+
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <unistd.h>
+
+// Gives the brush work of a frame a share of the frame time, a stage at a time in priority order:
+// paint, then normals, then upload. A stage runs a batch, then more while it has a backlog, is
+// short of its deadline and under its batch cap, and what it leaves carries over to the next frame.
+// Deadlines add up stage by stage from BeginFrame(), so time that one stage doesn't use goes to
+// the stages after it
+struct AppScheduler
+{
+    enum stage_type { PaintStage, NormalStage, UploadStage, StageCount };
+
+    float frameSec = 1.f / 30;      // the frame time to keep to, from the platform
+    float workFraction = .5f;       // of that, for brush work. the rest is for rendering and the platform
+    float shares[ StageCount ] = { .5f, .3f, .2f }; // of the brush work's time
+
+    size_t backlogs[ StageCount ] = {}; // as each stage last left it
+    size_t batches[ StageCount ] = {};  // each stage's batches this frame
+
+    void BeginFrame(float frameSec_) { frameSec = frameSec_; frameStart = Now(); }
+
+    // until EndDrain(), stages run until their backlog is gone or budgetSec from now is spent,
+    // for work that can't carry over to the next frame
+    void BeginDrain(float budgetSec) { drainEnd = Now() + budgetSec; }
+    void EndDrain() { drainEnd = 0; }
+
+    // fnBatch() does some of the stage's work and fnBacklog() is how much is waiting
+    template<class BatchFn, class BacklogFn>
+    void Run(stage_type stage, BatchFn fnBatch, BacklogFn fnBacklog, size_t maxBatches = ~size_t(0))
+    {
+        const double deadline = drainEnd > 0 ? drainEnd : frameStart + Deadline( stage );
+        batches[ stage ] = 0;
+        do
+        {
+            fnBatch();
+            batches[ stage ]++;
+        }
+        while( ( backlogs[ stage ] = fnBacklog() ) > 0 && batches[ stage ] < maxBatches && Now() < deadline );
+    }
+
+    static double Now(); // in seconds, monotonic
+
+private:
+    double frameStart = 0;
+    double drainEnd = 0;
+
+    double Deadline(stage_type stage) const; // from the start of the frame
+};
+
+#endif //_APPSCHEDULER_HPP_
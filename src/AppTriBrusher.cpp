@@ -25,6 +25,10 @@
 
 //#define CHECK_DEADZONES
 
+const size_t kStrokeRays = 16; // samples picked together
+const uint kWalkSteps = 8; // tris the surface walk crosses before it gives up on a sample
+const int kStrideMax = 64; // pixels between samples, at most
+
 inline float glLength(const glm::vec3& vec) { return sqrt( glm::dot(vec, vec) ); }
 
 void AppTriBrusher::Bind(IIdentifyTri* pIT, IDefineTri* pDT)
@@ -34,6 +38,13 @@ void AppTriBrusher::Bind(IIdentifyTri* pIT, IDefineTri* pDT)
 
     adjMarkings.resize( pTriangular->GetIndTris().size() );
     paintMarkings.resize( pTriangular->GetIndTris().size() );
+
+    // a batch of samples, each with the tris walked over to reach it
+    strokeCxts.reserve( kStrokeRays * ( kWalkSteps + 1 ) );
+    strokeDirs.reserve( kStrokeRays );
+    strokeMisses.reserve( kStrokeRays );
+    strokeMissCxts.reserve( kStrokeRays );
+    strokePath.reserve( kWalkSteps );
 }
 void AppTriBrusher::Release()
 {
@@ -42,28 +53,32 @@ void AppTriBrusher::Release()
     pTriangular = 0;
 }
 
-void AppTriBrusher::Start(glm::vec3 const & p, glm::vec3 const & camera,
+// sets up a stroke from the tri under p, and whether there is one to queue a patch about
+bool AppTriBrusher::Begin(glm::vec3 const & p, glm::vec3 const & camera,
                           std::function<glm::vec3(glm::vec3)> fnProj,
                           std::function<glm::vec3(glm::vec3)> fnUnproj,
-                          EffectorFn fnTE,
                           float patch) // todo: won't work under rotation
 {
     posLast = posStart = vecLastEnd = p;
     deqSegments.clear(); // check
+    strokeCxts.clear();
+    strokeNext = 0;
 
     posCamera = camera;
     fnProject = fnProj;
     fnUnproject = fnUnproj;
-    fnTriEffector = fnTE;
 
     // cast 3d ray to find tri
     const auto posCursor = fnUnproject( posStart );
     const auto incidentVec = glm::normalize( posCursor - posCamera );
-    pCollisionBody->IdentifyTri( searchCxt, posCamera, incidentVec );
+    const trisearch_type lastCxt = searchCxt;
+    pCollisionBody->IdentifyTris( &searchCxt, lastCxt, posCamera, &incidentVec, 1 );
+    strokeFrom = searchCxt;
+    strokeFromDir = incidentVec;
     if(searchCxt.collisionTri == TriIDEnd)
     {
         AppLog::Warn(__FILENAME__,"searchCxt.collisionTri == TriIDEnd");
-        return;
+        return false;
     }
 
     // find tri center and normal direction, per projection
@@ -81,26 +96,15 @@ void AppTriBrusher::Start(glm::vec3 const & p, glm::vec3 const & camera,
     adjDeque.clear();
 
     strokeSerial++;
-
-    if( patchSize < std::numeric_limits<float>::min())
-    {
-        adjDeque.push_back( { searchCxt.collisionTri, 1 } );
-    }
-    else
-    {
-        adjSerial++; // find next adj-set
-        AdjTriVisitor(
-            adjDeque,
-            searchCxt.collisionTri, pTriangular->GetIndTriAdjTris(),
-            adjSerial, adjMarkings,
-            fnTriEffector
-        );
-    }
+    return true;
 }
 
 void AppTriBrusher::Stop()
 {
     deqSegments.clear();
+    adjDeque.clear();
+    strokeCxts.clear();
+    strokeNext = 0;
 }
 
 void AppTriBrusher::Continue(glm::vec3 const & p)
@@ -119,113 +123,150 @@ void AppTriBrusher::Continue(glm::vec3 const & p)
     vecLastEnd = p;
 }
 
-void AppTriBrusher::Stroke_handled( PaintFn fnPaint, uint batchSize )
+size_t AppTriBrusher::SegmentPixels() const
 {
-    if(searchCxt.collisionTri == TriIDEnd) return;
-
-    // stroke the initial triangle-patch-set based upon 2d cursor movement across the near-plane
-    while (--batchSize) {
-        if (deqSegments.empty()) break;
+    size_t pixels = 0;
+    for( size_t i = 0; i < deqSegments.size(); i++ ) pixels += size_t( deqSegments[ i ].count + 1 );
+    return pixels;
+}
 
-        deqSegments.front().pos += deqSegments.front().delta;
-        if (glLength(posLast - deqSegments.front().pos) < 1.f) continue;
+// steps the handle along the segments, and whether it moved on to a new pixel
+bool AppTriBrusher::HandleStep(float& handleEffect_out)
+{
+    deqSegments.front().pos += deqSegments.front().delta;
+    if (glLength(posLast - deqSegments.front().pos) < 1.f) return false;
 
-        posLast = deqSegments.front().pos;
+    posLast = deqSegments.front().pos;
 
-        deqSegments.front().count--;
-        if (deqSegments.front().count < 0) deqSegments.pop_front();
+    deqSegments.front().count--;
+    if (deqSegments.front().count < 0) deqSegments.pop_front();
 
-        ///////
+    ///////
 
-        const auto moveVect = posLast - posStart; // window 2d cords
-        const float angleM = std::atan2(moveVect.y, moveVect.x);
-        const float handleDir = std::fabs(angleM - startNorm_Angle) > float(M_PI / 2) ? -1.f : +1.f;
-        const float handleScale = std::pow(1. + patchSize, -3.); // todo: was inverse cubic
+    const auto moveVect = posLast - posStart; // window 2d cords
+    const float angleM = std::atan2(moveVect.y, moveVect.x);
+    const float handleDir = std::fabs(angleM - startNorm_Angle) > float(M_PI / 2) ? -1.f : +1.f;
+    const float handleScale = std::pow(1. + patchSize, -3.); // todo: was inverse cubic
 
-        if (patchSize < std::numeric_limits<float>::min()) {
-            fnPaint(searchCxt.collisionTri, 1.f, handleScale * handleDir * glLength(moveVect) / startNorm_Len);
-        } else {
-            for (const auto& triadj : adjDeque) { // todo: added const &
-                fnPaint(triadj.triID, triadj.effect, handleScale * handleDir * glLength(moveVect) / startNorm_Len);
-            }
-        }
-    }
+    handleEffect_out = handleScale * handleDir * glLength(moveVect) / startNorm_Len;
+    return true;
 }
 
-void AppTriBrusher::Stroke( PaintFn fnPaint, uint batchSize )
+// takes the next sample picked ahead, and whether it is a new tri to paint about
+AppTriBrusher::pick_type AppTriBrusher::PickNext()
 {
-    int pulled = 0;
-
-    // update and stroke the triangle-patch-set based upon 3d cursor movement across the geometry
-    while( --batchSize )
-    {
-        if( !adjDeque.empty() )
-        {
-            auto triadj = adjDeque.front();
-            adjDeque.pop_front();
-            pulled++;
-
-            // prevent selection of this tri later in current adj-set
-            if( !cheatUnsafeSelection ) paintMarkings[ triadj.triID ] = adjSerial;
+    if( strokeNext == strokeCxts.size() && !PickAhead() ) return PickedNone;
+    auto trialCxt = strokeCxts[ strokeNext++ ];
 
 #if defined(CHECK_DEADZONES)
-            AppLog::Info( __FILENAME__, "%s painting: triID %4X", __func__, triadj.triID );
+    if( patchSize < std::numeric_limits<float>::min())
+        AppLog::Warn(__FILENAME__,"%s: %d - %04X (%04X)", __func__,trialCxt.collisionTri,trialCxt.collisionBin,trialCxt.lastValidBin);
 #endif // CHECK_DEADZONES
 
-            fnPaint(triadj.triID, triadj.effect, 0);
-            continue; // keep pulling
-        }
+    // a sample that's no use keeps the stroke parsing deqSegments in the hopes of finding a valid tri
+    if( !trialCxt.IsValid() ) return PickedSame; // likely brushing off-object
+    if( trialCxt.collisionTri == searchCxt.collisionTri ) return PickedSame; // same tri
+    if( paintMarkings[trialCxt.collisionTri] == adjSerial ) return PickedSame; // just-painted tri
 
-        if( deqSegments.empty()) break;
+    searchCxt = trialCxt; // found a new tri, store it
+    return PickedNew;
+}
 
-        deqSegments.front().pos += deqSegments.front().delta;
-        posLast = deqSegments.front().pos;
+// the on-screen width of a tri across its longest edge, in whole pixels
+int AppTriBrusher::SampleStride(triID_type triID)
+{
+    glm::vec3 v0, v1, v2;
+    pTriangular->GetTriVerts( v0, v1, v2, triID );
 
-        deqSegments.front().count--;
-        if( deqSegments.front().count < 0 ) deqSegments.pop_front();
+    const glm::vec2 p0( fnProject( v0 ) ), p1( fnProject( v1 ) ), p2( fnProject( v2 ) );
+    const glm::vec2 e0( p1 - p0 ), e1( p2 - p1 ), e2( p0 - p2 );
+    const float area2 = std::fabs( e0.x * e2.y - e0.y * e2.x );
+    const float longest = std::sqrt( std::max( glm::dot( e0, e0 ), std::max( glm::dot( e1, e1 ), glm::dot( e2, e2 ) ) ) );
+    if( !( longest > 0.f ) ) return 1;
 
-        ///////
+    return int( glm::clamp( area2 / longest, 1.f, float( kStrideMax ) ) );
+}
 
-        // find next valid tri
-        auto posCursor = fnUnproject( posLast );
-        auto incidentVec = glm::normalize( posCursor - posCamera );
-        auto trialCxt = searchCxt;
-        pCollisionBody->IdentifyTri( trialCxt, posCamera, incidentVec );
+// steps along the segments for the next samples and picks them ahead, against the model as it is
+// before the patches they lead to are painted, which is a pixel or so of lag.
+// samples mostly land on the last hit or a neighbour of it, so each walks over the surface from the
+// one before. it stays on the surface the stroke is on, where a pick would see a fold in front of
+// it, but the first sample the walk can't reach and all after it go to the picker in one batch.
+// while walking, samples are a stride apart that is about the width of the last tri hit, and
+// the tris a stride steps over come from the walk. a stride the walk fails is taken again a pixel
+// at a time from the last good sample. the picker's samples are a pixel apart
+bool AppTriBrusher::PickAhead()
+{
+    if( deqSegments.empty() ) return false;
 
-#if defined(CHECK_DEADZONES)
-        if( patchSize < std::numeric_limits<float>::min())
-            AppLog::Warn(__FILENAME__,"%s: %d - %04X (%04X)", __func__,trialCxt.collisionTri,trialCxt.collisionBin,trialCxt.lastValidBin);
-#endif // CHECK_DEADZONES
+    // walks start from the last sample hit, which can be well ahead of the last tri painted
+    triID_type triFrom = strokeFrom.collisionTri;
 
-        // use continue to keep parsing deqSegments in the hopes of finding a valid tri
-        if( !trialCxt.IsValid() ) continue; // likely brushing off-object
-        if( trialCxt.collisionTri == searchCxt.collisionTri ) continue; // same tri
-        if( paintMarkings[trialCxt.collisionTri] == adjSerial ) continue; // just-painted tri
+    strokeCxts.clear();
+    strokeNext = 0;
+    strokeDirs.clear();
+    strokeMisses.clear();
 
-        searchCxt = trialCxt; // found a new tri, store it
+    triID_type strideTri = TriIDEnd;
+    int stride = 1;
+    for( size_t samples = 0; samples < kStrokeRays && !deqSegments.empty(); samples++ )
+    {
+        if( triFrom != strideTri )
+        {
+            strideTri = triFrom;
+            stride = triFrom == TriIDEnd ? 1 : SampleStride( triFrom );
+        }
+
+        Segment& segment = deqSegments.front();
+        const int steps = std::min( stride, segment.count + 1 );
+        const glm::vec3 pos = segment.pos + segment.delta * float( steps );
+        const glm::vec3 direction = glm::normalize( fnUnproject( pos ) - posCamera );
 
-        if( patchSize < std::numeric_limits<float>::min())
+        trisearch_type cxt = searchCxt;
+        strokePath.clear();
+        const bool walked = triFrom != TriIDEnd && TriWalk( cxt, triFrom, *pTriangular, posCamera, strokeFromDir, direction, kWalkSteps, &strokePath );
+        if( !walked && steps > 1 )
         {
-            adjDeque.push_back( { searchCxt.collisionTri, 1 } );
+            // the stride may have crossed an edge of what the walk can reach, so resample from the
+            // last good sample a pixel at a time, or the pixels it stepped over would go unpicked
+            stride = 1;
+            continue;
         }
-        else
+
+        segment.pos = pos;
+        posLast = pos;
+        segment.count -= steps;
+        if( segment.count < 0 ) deqSegments.pop_front();
+
+        if( walked )
         {
-            adjSerial++; // find next adj-set
-            AdjTriVisitor(
-                adjDeque,
-                searchCxt.collisionTri, pTriangular->GetIndTriAdjTris(),
-                adjSerial, adjMarkings,
-                fnTriEffector
-            );
+            strokeFrom = cxt;
+            strokeFromDir = direction;
+            for( triID_type triID : strokePath )
+            {
+                strokeCxts.push_back( cxt ); // hit details are of the sample's tri
+                strokeCxts.back().collisionTri = triID;
+            }
+            strokeCxts.push_back( cxt );
+            triFrom = cxt.collisionTri;
+            continue;
         }
+        triFrom = TriIDEnd;
 
-#ifdef CHATTY
-        AppLog::Info(__FILENAME__, "queued %d", adjDeque.size());
-#endif
+        strokeMisses.push_back( strokeCxts.size() );
+        strokeCxts.push_back( cxt );
+        strokeDirs.push_back( direction );
     }
+    if( strokeMisses.empty() ) return true;
 
-#ifdef CHATTY
-    if (pulled > 0) AppLog::Info(__FILENAME__, "%d pulled", pulled);
-#endif
-}
+    strokeMissCxts.resize( strokeMisses.size() );
+    pCollisionBody->IdentifyTris( strokeMissCxts.data(), searchCxt, posCamera, strokeDirs.data(), uint( strokeMisses.size() ) );
+    for( size_t i = 0; i < strokeMisses.size(); i++ ) strokeCxts[ strokeMisses[ i ] ] = strokeMissCxts[ i ];
 
+    if( strokeCxts.back().IsValid() )
+    {
+        strokeFrom = strokeCxts.back();
+        strokeFromDir = strokeDirs.back();
+    }
+    return true;
+}
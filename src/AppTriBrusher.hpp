@@ -5,7 +5,6 @@
 
 #include <unistd.h>
 #include <vector>
-#include <deque>
 #include <cmath>
 #include <limits>
 #include <map>
@@ -26,7 +25,7 @@ struct AppTriBrusher
         glm::vec3 delta;
         int count;
     };
-    std::deque<Segment> deqSegments;
+    ring_tmpl<Segment> deqSegments;
     glm::vec3 vecLastEnd;
 
     IIdentifyTri* pCollisionBody = 0;
@@ -43,31 +42,136 @@ struct AppTriBrusher
     float startNorm_Len; // start tri's normal 2d (pixel) length
 
     std::vector<serial_type> adjMarkings; // for adj tri selection
-    std::deque<trieffect_type> adjDeque;
+    ring_tmpl<trieffect_type> adjDeque;
     trisearch_type searchCxt;
+    std::vector<trisearch_type> strokeCxts; // picked ahead along the segments, used from strokeNext
+    size_t strokeNext = 0;
+    std::vector<glm::vec3> strokeDirs;
+    std::vector<size_t> strokeMisses; // the samples the surface walk didn't reach
+    std::vector<trisearch_type> strokeMissCxts;
+    std::vector<triID_type> strokePath; // walked over between two samples
+    trisearch_type strokeFrom; // the last sample hit, where the next walk starts
+    glm::vec3 strokeFromDir;
     std::vector<serial_type> paintMarkings; // prevent selection of tris painted in current stroke
 
     glm::vec3 posCamera;
     std::function<glm::vec3(glm::vec3)> fnProject;
     std::function<glm::vec3(glm::vec3)> fnUnproject;
-    EffectorFn fnTriEffector;
+    adjrings_type adjRings; // scratch for AdjTriVisitor
 
     bool cheatUnsafeSelection = false;
 
     void Bind(IIdentifyTri* pIT, IDefineTri* pDT);
     void Release();
 
+    // Tools are policy types, so each Start and Stroke compiles to its own kernel with the tool inlined.
+    // A tool has Effects(const triID_type* tris, uint n, float* effects_out), the patch falloff as
+    // AdjTriVisitor takes it, and Paint(triID_type triID, float patchEffect, float handleEffect)
+
     // start for handled warping
+    template<class Tool>
     void Start(glm::vec3 const & p, glm::vec3 const & camera,
                std::function<glm::vec3(glm::vec3)> fnProj,
                std::function<glm::vec3(glm::vec3)> fnUnproj,
-               EffectorFn fnTE,
-               float ps);
+               Tool& tool,
+               float ps)
+    {
+        if( Begin( p, camera, fnProj, fnUnproj, ps ) ) QueuePatch( tool );
+    }
 
     void Stop();
     void Continue(glm::vec3 const & p);
-    void Stroke_handled( PaintFn fnPaint, uint batchSize );
-    void Stroke( PaintFn fnPaint, uint batchSize );
+
+    // the work Stroke() has waiting: patch tris, samples picked ahead, and pixels of segments.
+    // Stroke_handled() paints the whole patch each pixel, so it only has the pixels
+    size_t Backlog() const { return adjDeque.size() + ( strokeCxts.size() - strokeNext ) + SegmentPixels(); }
+    size_t HandleBacklog() const { return searchCxt.collisionTri == TriIDEnd ? 0 : SegmentPixels(); }
+
+    template<class Tool>
+    void Stroke_handled( Tool& tool, uint batchSize );
+    template<class Tool>
+    void Stroke( Tool& tool, uint batchSize );
+
+private:
+    enum pick_type { PickedNone, PickedSame, PickedNew };
+
+    size_t SegmentPixels() const;
+
+    bool Begin(glm::vec3 const & p, glm::vec3 const & camera,
+               std::function<glm::vec3(glm::vec3)> fnProj,
+               std::function<glm::vec3(glm::vec3)> fnUnproj,
+               float ps);
+    bool HandleStep(float& handleEffect_out);
+    pick_type PickNext();
+    template<class Tool>
+    void QueuePatch( Tool& tool );
+    int SampleStride(triID_type triID);
+    bool PickAhead();
 };
 
+template<class Tool>
+void AppTriBrusher::Stroke_handled( Tool& tool, uint batchSize )
+{
+    if(searchCxt.collisionTri == TriIDEnd) return;
+
+    // stroke the initial triangle-patch-set based upon 2d cursor movement across the near-plane
+    float handleEffect;
+    while (--batchSize) {
+        if (deqSegments.empty()) break;
+        if (!HandleStep(handleEffect)) continue;
+
+        if (patchSize < std::numeric_limits<float>::min()) {
+            tool.Paint(searchCxt.collisionTri, 1.f, handleEffect);
+        } else {
+            for (size_t i = 0; i < adjDeque.size(); i++) {
+                tool.Paint(adjDeque[i].triID, adjDeque[i].effect, handleEffect);
+            }
+        }
+    }
+}
+
+template<class Tool>
+void AppTriBrusher::Stroke( Tool& tool, uint batchSize )
+{
+    // update and stroke the triangle-patch-set based upon 3d cursor movement across the geometry
+    while( --batchSize )
+    {
+        if( !adjDeque.empty() )
+        {
+            auto triadj = adjDeque.front();
+            adjDeque.pop_front();
+
+            // prevent selection of this tri later in current adj-set
+            if( !cheatUnsafeSelection ) paintMarkings[ triadj.triID ] = adjSerial;
+
+            tool.Paint(triadj.triID, triadj.effect, 0);
+            continue; // keep pulling
+        }
+
+        // find next valid tri
+        const pick_type picked = PickNext();
+        if( picked == PickedNone ) break;
+        if( picked == PickedNew ) QueuePatch( tool );
+    }
+}
+
+template<class Tool>
+void AppTriBrusher::QueuePatch( Tool& tool )
+{
+    if( patchSize < std::numeric_limits<float>::min())
+    {
+        adjDeque.push_back( { searchCxt.collisionTri, 1 } );
+    }
+    else
+    {
+        adjSerial++; // find next adj-set
+        AdjTriVisitor(
+            adjDeque,
+            searchCxt.collisionTri, pTriangular->GetIndTriAdjTris(),
+            adjSerial, adjMarkings,
+            tool, adjRings
+        );
+    }
+}
+
 #endif //_APPTRIBRUSHER_HPP_
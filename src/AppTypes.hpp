@@ -9,16 +9,33 @@
 #include <map>
 #include <set>
 #include <functional>
+#include <algorithm>
+#include <utility>
 
 #include <glm/glm.hpp>
 #include <glm/vec3.hpp>
 #include <deque>
 
+#include "AppCowArray.hpp"
+
+// mesh ids are 32 bits unless built with SMALLMESH, which caps models at ~65k verts or tris.
+// gpu index buffers are packed to 16 bits at bind-time whenever the model fits.
+#if defined(SMALLMESH)
+typedef uint16_t meshID_type;
+#else
+typedef uint32_t meshID_type;
+#endif
+
+template<class T> struct meshID_traits;
+template<> struct meshID_traits<uint16_t> { using key_type = uint32_t; static const unsigned int gl_typeid = 0x1403; }; // GL_UNSIGNED_SHORT
+template<> struct meshID_traits<uint32_t> { using key_type = uint64_t; static const unsigned int gl_typeid = 0x1405; }; // GL_UNSIGNED_INT
+
 typedef uint16_t serial_type;
-typedef uint16_t vertID_type;
+typedef meshID_type vertID_type;
 typedef uint16_t binID_type;
-typedef uint16_t triID_type;
-typedef uint32_t binID_triID_key;
+typedef meshID_type triID_type;
+typedef meshID_traits<meshID_type>::key_type vertID_vertID_key; // edge key, two vertIDs
+typedef meshID_traits<meshID_type>::key_type binID_triID_key; // bin/tri key, one binID and one triID
 
 const triID_type TriIDEnd = std::numeric_limits<triID_type>::max();
 const triID_type TriIDBegin = 0;
@@ -41,38 +58,132 @@ struct trieffect_type
 
 inline bool operator<(const trieffect_type l, const trieffect_type r) { return l.triID < r.triID; }
 
-struct ind3_type: public glm::tvec3<uint16_t>
+template<class T>
+struct ind3_tmpl: public glm::tvec3<T>
+{
+    ind3_tmpl() {}
+    ind3_tmpl(T a, T b, T c) : glm::tvec3<T>(a,b,c) {}
+    using base_type = T;
+    static const unsigned int base_typeid = meshID_traits<T>::gl_typeid;
+};
+
+using ind3_type = ind3_tmpl<meshID_type>;
+
+using vertarray_type = AppCowArray<glm::vec3>; // per-vertex model attributes
+
+// dirty bits, with the extents of the marked words kept for quick clears and scans
+struct dirtybits_type
+{
+    std::vector<uint32_t> words;
+    size_t bits = 0;
+    size_t lo = 0, hi = 0; // marked words are in [lo,hi)
+
+    void Resize(size_t bits_) { bits = bits_; words.assign( (bits + 31) >> 5, 0 ); lo = words.size(); hi = 0; }
+    size_t Size() const { return bits; }
+    bool Any() const { return lo < hi; }
+    bool Test(size_t i) const { return ( words[ i >> 5 ] >> (i & 31) ) & 1; }
+    size_t Count() const
+    {
+        size_t n = 0;
+        for( size_t w = lo; w < hi; w++ ) n += __builtin_popcount( words[ w ] );
+        return n;
+    }
+    void Clear(size_t i) { words[ i >> 5 ] &= ~(1u << (i & 31)); } // extents stay as they were
+    void Set(size_t i)
+    {
+        const size_t w = i >> 5;
+        words[ w ] |= 1u << (i & 31);
+        if( w < lo ) lo = w;
+        if( w >= hi ) hi = w + 1;
+    }
+    void SetAll()
+    {
+        if( words.empty() ) return;
+        std::fill( words.begin(), words.end(), ~0u );
+        if( bits & 31 ) words.back() = (1u << (bits & 31)) - 1;
+        lo = 0; hi = words.size();
+    }
+    void Clear()
+    {
+        if( Any() ) std::fill( words.begin() + lo, words.begin() + hi, 0 );
+        lo = words.size(); hi = 0;
+    }
+
+    // visits set bits in ascending order
+    template<class Fn>
+    void ForEach(Fn fn) const
+    {
+        for( size_t w = lo; w < hi; w++ )
+            for( uint32_t bits = words[ w ]; bits; bits &= bits - 1 )
+                fn( (w << 5) + __builtin_ctz( bits ) );
+    }
+};
+
+// compressed rows: row r is items[ offsets[r] ] up to items[ offsets[r+1] ]
+template<class T>
+struct csr_tmpl
+{
+    std::vector<size_t> offsets; // one past the rows
+    std::vector<T> items;
+
+    size_t Rows() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    size_t Count(size_t r) const { return offsets[ r + 1 ] - offsets[ r ]; }
+    const T* begin(size_t r) const { return items.data() + offsets[ r ]; }
+    const T* end(size_t r) const { return items.data() + offsets[ r + 1 ]; }
+};
+
+using vertTris_type = csr_tmpl<triID_type>; // the tris using each vert
+
+// a fifo in a power of two ring of slots. the ring doubles when full and is kept when emptied,
+// so a queue that runs at about the same depth stroke after stroke doesn't allocate
+template<class T>
+struct ring_tmpl
 {
-    ind3_type() {}
-    ind3_type(uint16_t a, uint16_t b, uint16_t c) : glm::tvec3<uint16_t>(a,b,c) {}
-    using base_type = uint16_t;
-    static const unsigned int base_typeid = 0x1403; //GL_UNSIGNED_SHORT;
+    std::vector<T> slots;
+    size_t head = 0, count = 0;
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+    void clear() { head = count = 0; }
+    T& operator[](size_t i) { return slots[ ( head + i ) & ( slots.size() - 1 ) ]; }
+    const T& operator[](size_t i) const { return slots[ ( head + i ) & ( slots.size() - 1 ) ]; }
+    T& front() { return slots[ head ]; }
+    T& back() { return (*this)[ count - 1 ]; }
+    void pop_front() { head = ( head + 1 ) & ( slots.size() - 1 ); count--; }
+    void pop_back() { count--; }
+    void push_back(const T& t) { Grow(); slots[ ( head + count++ ) & ( slots.size() - 1 ) ] = t; }
+    void push_back(T&& t) { Grow(); slots[ ( head + count++ ) & ( slots.size() - 1 ) ] = std::move( t ); }
+    void Grow()
+    {
+        if( count < slots.size() ) return;
+        std::vector<T> grown( std::max<size_t>( 64, slots.size() * 2 ) );
+        for( size_t i = 0; i < count; i++ ) grown[ i ] = std::move( (*this)[ i ] );
+        slots.swap( grown );
+        head = 0;
+    }
 };
 
 struct trisearch_type
 {
     triID_type collisionTri;
-    binID_type collisionBin;
+    glm::vec2 collisionBary; // of the hit in collisionTri, from its first vert to the second and third
+    float collisionDist; // along the ray to the hit
+    binID_type collisionBin; // CRubus's
     binID_type lastValidBin;
 
     trisearch_type() { Invalidate(); }
     void Invalidate()
     {
         collisionTri = TriIDEnd;
+        collisionDist = 0.f;
         collisionBin = BinIDEnd;
         lastValidBin = 0; // must never be invalid
     }
-    bool IsValid() { return collisionTri != TriIDEnd && collisionBin != BinIDEnd; }
+    bool IsValid() { return collisionTri != TriIDEnd; }
 };
 
 //////////////////
 
-using PaintFn = std::function<void(triID_type, float /* patchEffect */, float /* handleEffect */)>;
-
-using EffectorFn = std::function< std::pair<bool /* include */, float /* patchEffect */>(triID_type)>;
-
-//////////////////
-
 // a collision alg requires this to iterate on tris and get their data
 struct IDefineTri
 {
@@ -87,6 +198,10 @@ struct IDefineTri
 struct IIdentifyTri
 {
     virtual void IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm::vec3 const &direction) = 0;
+
+    // the nearest hit for each of n unit rays from position, eg the samples along a stroke, all
+    // searched from cxt. hits are on front faces, as glm::intersectRayTriangle only sees those
+    virtual void IdentifyTris(trisearch_type* cxts_out, const trisearch_type& cxt, glm::vec3 const &position, const glm::vec3* directions, uint n) = 0;
 };
 
 // for triangle renormalization
@@ -96,12 +211,16 @@ struct IRenormalizable
 
     virtual uint TriInd(triID_type t) = 0;
     virtual ind3_type TriVertInd(triID_type t) = 0;
-    virtual ind3_type AdjTriInd(triID_type t) = 0; // on a surface there should be 6 adjacent tris... we only pick 3 here!
+    virtual ind3_type AdjTriInd(triID_type t) = 0; // the tris sharing an edge, or TriIDEnd
     virtual bool HasDegenerates() = 0;
 
     virtual std::vector<glm::vec3>& GetNormTris() = 0;
-    virtual std::vector<glm::vec3>& GetNormVerts() = 0;
-    virtual std::vector<glm::vec3>& GetPosVerts() = 0;
+    virtual vertarray_type& GetNormVerts() = 0;
+    virtual vertarray_type& GetPosVerts() = 0;
+    virtual const vertTris_type& GetVertTris() = 0;
+
+    virtual void UpdateNorm(vertID_type v) = 0; // a vert normal changed and needs uploading
+    virtual void UpdateAllNorms() = 0; // they all did
 };
 
 ///////////////
@@ -0,0 +1,154 @@
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+
+#include "GL9.hpp"
+
+#include "AppUploader.hpp"
+#include "AppLog.hpp"
+
+const uint8_t AppUploadStream::MaxCopies;
+
+#define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
+
+//#define CHECK_SUBDATA
+
+// visits runs of set bits [first,end), joining runs separated by up to gap clear bits
+template<class Fn>
+static void ForEachRun(const dirtybits_type& marks, size_t gap, Fn fn)
+{
+    size_t runFirst = 0, runEnd = 0;
+    bool inRun = false;
+    marks.ForEach( [&] (size_t c) {
+        if( inRun && c <= runEnd + gap ) { runEnd = c + 1; return; }
+        if( inRun ) fn( runFirst, runEnd );
+        runFirst = c; runEnd = c + 1; inRun = true;
+    } );
+    if( inRun ) fn( runFirst, runEnd );
+}
+
+const char* AppUploadSettings::StrategyName() const
+{
+    switch( strategy )
+    {
+        case InstantStrategy: return "instant";
+        case ExtentsStrategy: return "extents";
+        case ChickletStrategy: return "chicklets";
+        default: return "?";
+    }
+}
+
+void AppUploadStream::Upload(const span_type& fnSpan, size_t first, size_t end)
+{
+    for( size_t i = first; i < end; )
+    {
+        size_t count;
+        const void* p = fnSpan( i, count );
+        count = std::min( count, end - i );
+#if defined(CHECK_SUBDATA)
+        AppLog::Info( __FILENAME__, "%s %4zu %4zu", __func__, i * itemBytes, count * itemBytes );
+#endif // CHECK_SUBDATA
+        gl9BufferSubData( GL_ARRAY_BUFFER, i * itemBytes, count * itemBytes, p );
+        pStats->Count( count * itemBytes );
+        i += count;
+    }
+}
+
+void AppUploadStream::Fill(const span_type& fnSpan)
+{
+    const GLenum usage = copies > 1 ? GL_STREAM_DRAW : GL_STATIC_DRAW;
+
+    size_t count = 0;
+    const void* p = items ? fnSpan( 0, count ) : 0;
+    if( count >= items )
+    {
+        gl9BufferData( GL_ARRAY_BUFFER, items * itemBytes, p, usage );
+        pStats->Count( items * itemBytes );
+    }
+    else
+    {
+        gl9BufferData( GL_ARRAY_BUFFER, items * itemBytes, 0, usage );
+        Upload( fnSpan, 0, items );
+    }
+}
+
+void AppUploadStream::Bind(span_type fnSpan, size_t itemBytes_, size_t items_, AppUploadSettings const* pSet, AppUploadStats* pSta)
+{
+    pSettings = pSet;
+    pStats = pSta;
+    itemBytes = itemBytes_;
+    items = items_;
+    copies = std::max<uint8_t>( 1, std::min( MaxCopies, pSettings->copies ) );
+    front = 0;
+
+    const size_t chicklets = ( (items + (size_t(1) << pSettings->chickletBitSize) -1) >> pSettings->chickletBitSize );
+
+    gl9GenBuffers( copies, bo );
+    for( uint8_t i = 0; i < copies; i++ )
+    {
+        gl9BindBuffer( GL_ARRAY_BUFFER, bo[ i ] );
+        Fill( fnSpan );
+        dirty[ i ].Resize( chicklets );
+    }
+    gl9BindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+void AppUploadStream::Release()
+{
+    if( copies ) gl9DeleteBuffers( copies, bo );
+    for( uint8_t i = 0; i < MaxCopies; i++ ) { bo[ i ] = 0; dirty[ i ].Resize( 0 ); }
+    copies = front = 0;
+}
+
+void AppUploadStream::Put(size_t item, const void* pItem)
+{
+    const auto bStart = item * itemBytes;
+    for( uint8_t i = 0; i < copies; i++ )
+    {
+        gl9BindBuffer( GL_ARRAY_BUFFER, bo[ i ] );
+        gl9BufferSubData( GL_ARRAY_BUFFER, bStart, itemBytes, pItem );
+        pStats->Count( itemBytes );
+    }
+    gl9BindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+void AppUploadStream::Tick(span_type fnSpan)
+{
+    if( !Dirty() ) return;
+
+    const uint8_t next = Next();
+    dirtybits_type& marks = dirty[ next ];
+
+    const size_t cItems = size_t(1) << pSettings->chickletBitSize;
+    const size_t vBytes = items * itemBytes;
+    const size_t gap = pSettings->strategy == AppUploadSettings::ExtentsStrategy ? marks.Size() : pSettings->gapChicklets;
+
+    gl9BindBuffer( GL_ARRAY_BUFFER, bo[ next ] );
+
+    auto fnUpload = [&] (size_t cFirst, size_t cEnd)
+    {
+        Upload( fnSpan, cFirst * cItems, std::min( items, cEnd * cItems ) ); // clip
+    };
+
+    // measure the coalesced runs first to decide on orphaning
+    size_t dirtyBytes = 0;
+    ForEachRun( marks, gap, [&] (size_t cFirst, size_t cEnd) { dirtyBytes += (cEnd - cFirst) * cItems * itemBytes; } );
+
+    if( float(dirtyBytes) >= pSettings->orphanFraction * float(vBytes) )
+    {
+        // orphan: the driver hands back fresh storage instead of waiting on the draw
+        Fill( fnSpan );
+    }
+    else
+    {
+        ForEachRun( marks, gap, fnUpload );
+    }
+
+    gl9BindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    marks.Clear();
+    front = next;
+}
@@ -0,0 +1,108 @@
+#ifndef _APPUPLOADER_HPP_
+#define _APPUPLOADER_HPP_
+
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <unistd.h>
+#include <vector>
+#include <functional>
+
+#include "GL9.hpp"
+#include "AppTypes.hpp"
+
+struct AppUploadSettings
+{
+    // instant: a subdata call per changed item
+    // extents: one subdata call spanning all the changes, per tick
+    // chicklets: a subdata call per run of dirty chicklets, per tick
+    enum strategy_type { InstantStrategy, ExtentsStrategy, ChickletStrategy };
+
+    strategy_type strategy = ChickletStrategy;
+    uint16_t chickletBitSize = 4;   // items per dirty bit, as a power of 2. rebind streams after changing
+    uint gapChicklets = 1;          // coalesce dirty runs separated by up to this many clean chicklets
+    uint8_t copies = 1;             // 1 updates the drawn buffer, 2+ makes a ring and updates the least recently drawn
+    float orphanFraction = 1.1f;    // rewrite the whole buffer (orphaning it) when this much of it is dirty
+
+    const char* StrategyName() const;
+};
+
+struct AppUploadStats
+{
+    uint bytesUpdated = 0;                  // running total, cleared by the reader
+    uint frameBytes = 0, frameCalls = 0;    // accumulating in this frame
+    uint lastBytes = 0, lastCalls = 0;      // the previous frame
+
+    void Count(uint bytes) { bytesUpdated += bytes; frameBytes += bytes; frameCalls++; }
+    void EndFrame() { lastBytes = frameBytes; lastCalls = frameCalls; frameBytes = frameCalls = 0; }
+};
+
+// one vertex attribute's gpu buffer(s) and their dirty chicklets
+struct AppUploadStream
+{
+    static const uint8_t MaxCopies = 3;
+
+    GLuint bo[MaxCopies] = { 0, 0, 0 };
+    dirtybits_type dirty[MaxCopies]; // one set of dirty chicklets per copy
+    uint8_t copies = 0, front = 0;
+    size_t itemBytes = 0, items = 0;
+
+    AppUploadSettings const* pSettings = 0;
+    AppUploadStats* pStats = 0;
+
+    // where the items come from: a pointer to the given item and how many follow it contiguously
+    using span_type = std::function<const void*(size_t item, size_t& count)>;
+
+    span_type Contiguous(const void* data) const
+    {
+        return [this, data] (size_t item, size_t& count) -> const void* { count = items - item; return (const uint8_t*)data + item * itemBytes; };
+    }
+    template<class T, unsigned B>
+    static span_type Paged(const AppCowArray<T, B>& arr)
+    {
+        return [&arr] (size_t item, size_t& count) -> const void* { return arr.Span( item, count ); };
+    }
+
+    void Bind(span_type fnSpan, size_t itemBytes_, size_t items_, AppUploadSettings const* pSet, AppUploadStats* pSta);
+    void Bind(const void* data, size_t itemBytes_, size_t items_, AppUploadSettings const* pSet, AppUploadStats* pSta)
+    {
+        Bind( Contiguous( data ), itemBytes_, items_, pSet, pSta );
+    }
+    template<class T, unsigned B>
+    void Bind(const AppCowArray<T, B>& arr, AppUploadSettings const* pSet, AppUploadStats* pSta)
+    {
+        Bind( Paged( arr ), sizeof(T), arr.size(), pSet, pSta );
+    }
+    void Release();
+
+    uint8_t Next() const { return uint8_t( (front + 1) % copies ); }
+    GLuint Front() const { return bo[ front ]; }
+    bool Dirty() const { return copies > 0 && dirty[ Next() ].Any(); }
+    size_t Backlog() const { return copies > 0 ? dirty[ Next() ].Count() : 0; } // dirty chicklets for the next Tick
+
+    void Mark(size_t item)
+    {
+        const auto c = item >> pSettings->chickletBitSize;
+        for( uint8_t i = 0; i < copies; i++ ) dirty[ i ].Set( c );
+    }
+    void MarkAll() { for( uint8_t i = 0; i < copies; i++ ) dirty[ i ].SetAll(); }
+
+    void Put(size_t item, const void* pItem); // immediately, into every copy
+    void Update(size_t item, const void* pItem) // per the strategy
+    {
+        if( copies == 0 ) return; // not bound, eg a headless model
+        if( pSettings->strategy == AppUploadSettings::InstantStrategy ) Put( item, pItem );
+        else Mark( item );
+    }
+
+    // coalesced, into the next copy, which becomes the front
+    void Tick(span_type fnSpan);
+    void Tick(const void* data) { if( Dirty() ) Tick( Contiguous( data ) ); }
+    template<class T, unsigned B>
+    void Tick(const AppCowArray<T, B>& arr) { if( Dirty() ) Tick( Paged( arr ) ); }
+
+private:
+    void Upload(const span_type& fnSpan, size_t first, size_t end); // items [first,end) into the bound buffer
+    void Fill(const span_type& fnSpan); // all items, orphaning the bound buffer
+};
+
+#endif //_APPUPLOADER_HPP_
@@ -0,0 +1,356 @@
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#include "GL9.hpp"
+
+#include "CBvh.hpp"
+#include "AppLog.hpp"
+
+#define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
+
+//#define CHATTY
+
+const uint32_t CBvh::NodeEnd;
+
+const uint32_t kLeafTris = 4;
+const float kRebuildCost = 1.4f; // rebuild once refits have loosened the tree by this much
+
+inline CBvh::box_type BoxUnion(const CBvh::box_type& a, const CBvh::box_type& b)
+{
+    return { glm::min( a.lo, b.lo ), glm::max( a.hi, b.hi ) };
+}
+
+inline bool BoxEqual(const CBvh::box_type& a, const CBvh::box_type& b)
+{
+    return a.lo == b.lo && a.hi == b.hi;
+}
+
+inline float BoxArea(const CBvh::box_type& b)
+{
+    const glm::vec3 d = b.hi - b.lo;
+    return 2.f * ( d.x * d.y + d.y * d.z + d.z * d.x );
+}
+
+// the cost of a ray that hits the root, relative to the tree when it was built
+inline float TreeCost(const CBvh::tree_type& tree)
+{
+    return tree.nodes.empty() ? 0.f : tree.area / std::max( std::numeric_limits<float>::min(), BoxArea( tree.nodes[0].box ) );
+}
+
+void CBvh::Bind(IDefineTri* p)
+{
+    pTriangular = p;
+    Reset();
+}
+
+void CBvh::Release()
+{
+    pRebuild.reset(); // a build in flight owns what it writes to, so it's left to finish
+    tree = tree_type();
+    touchedTris.Resize( 0 );
+    touchedLeaves.Resize( 0 );
+    rebuildTris.Resize( 0 );
+    pTriangular = 0;
+}
+
+void CBvh::Reset()
+{
+    pRebuild.reset();
+
+    std::vector<box_type> boxes;
+    TriBoxes( boxes );
+    Build( tree, boxes );
+    builtCost = TreeCost( tree );
+
+    touchedTris.Resize( boxes.size() );
+    touchedLeaves.Resize( tree.nodes.size() );
+    rebuildTris.Resize( boxes.size() );
+
+    AppLog::Info(__FILENAME__, "bvh %zu nodes\n", tree.nodes.size());
+}
+
+CBvh::box_type CBvh::TriBox(triID_type triID)
+{
+    glm::vec3 v0, v1, v2;
+    pTriangular->GetTriVerts(v0, v1, v2, triID);
+    return { glm::min( v0, glm::min( v1, v2 ) ), glm::max( v0, glm::max( v1, v2 ) ) };
+}
+
+void CBvh::TriBoxes(std::vector<box_type>& boxes_out)
+{
+    boxes_out.resize( pTriangular->GetIndTris().size() );
+    AppJobs::Pool().ParallelFor( 0, boxes_out.size(), 4096, [&] (size_t first, size_t end) {
+        for(size_t triID = first; triID < end; triID++) boxes_out[ triID ] = TriBox( triID_type( triID ) );
+    } );
+}
+
+// splits at the median center along the widest spread of centers. only reads triBoxes, so it
+// can run on a copy in the background
+void CBvh::Build(tree_type& tree_out, const std::vector<box_type>& triBoxes)
+{
+    const size_t nTris = triBoxes.size();
+    tree_out = tree_type();
+    if( nTris == 0 ) return;
+
+    std::vector<glm::vec3> centers( nTris );
+    for(size_t t = 0; t < nTris; t++) centers[ t ] = ( triBoxes[ t ].lo + triBoxes[ t ].hi ) * .5f;
+
+    tree_out.tris.resize( nTris );
+    std::iota( tree_out.tris.begin(), tree_out.tris.end(), triID_type(0) );
+    tree_out.triLeaf.resize( nTris );
+    tree_out.nodes.reserve( 4 * nTris / kLeafTris );
+    tree_out.parents.reserve( 4 * nTris / kLeafTris );
+
+    tree_out.nodes.push_back( { box_type(), 0, uint32_t( nTris ) } );
+    tree_out.parents.push_back( NodeEnd );
+
+    std::vector<uint32_t> stack( 1, 0 );
+    while( !stack.empty() )
+    {
+        const uint32_t n = stack.back();
+        stack.pop_back();
+        const uint32_t first = tree_out.nodes[ n ].first, count = tree_out.nodes[ n ].count;
+        const auto iterFirst = tree_out.tris.begin() + first, iterEnd = iterFirst + count;
+
+        box_type box = triBoxes[ *iterFirst ];
+        box_type spread = { centers[ *iterFirst ], centers[ *iterFirst ] };
+        for( auto iter = iterFirst; iter != iterEnd; ++iter )
+        {
+            box = BoxUnion( box, triBoxes[ *iter ] );
+            spread = BoxUnion( spread, { centers[ *iter ], centers[ *iter ] } );
+        }
+        tree_out.nodes[ n ].box = box;
+
+        if( count <= kLeafTris )
+        {
+            for( auto iter = iterFirst; iter != iterEnd; ++iter ) tree_out.triLeaf[ *iter ] = n;
+            continue;
+        }
+
+        const glm::vec3 d = spread.hi - spread.lo;
+        const int axis = d.x >= d.y && d.x >= d.z ? 0 : ( d.y >= d.z ? 1 : 2 );
+        const uint32_t half = count / 2;
+        std::nth_element( iterFirst, iterFirst + half, iterEnd, [&] (triID_type a, triID_type b) {
+            return centers[ a ][ axis ] < centers[ b ][ axis ] || ( centers[ a ][ axis ] == centers[ b ][ axis ] && a < b );
+        } );
+
+        const uint32_t left = uint32_t( tree_out.nodes.size() );
+        tree_out.nodes.push_back( { box_type(), first, half } );
+        tree_out.nodes.push_back( { box_type(), first + half, count - half } );
+        tree_out.parents.push_back( n );
+        tree_out.parents.push_back( n );
+        tree_out.nodes[ n ].first = left;
+        tree_out.nodes[ n ].count = 0;
+
+        stack.push_back( left + 1 );
+        stack.push_back( left );
+    }
+
+    for( auto& node : tree_out.nodes ) if( node.count == 0 ) tree_out.area += BoxArea( node.box );
+}
+
+// grows or shrinks the touched leaves' boxes, then their ancestors' until one doesn't change.
+// a path that stops early was cut off by a box that another leaf's path has made or will make right
+void CBvh::Refit()
+{
+    Adopt();
+
+    if( !tree.nodes.empty() )
+    {
+        touchedTris.ForEach( [&] (size_t t) { touchedLeaves.Set( tree.triLeaf[ t ] ); } );
+        touchedLeaves.ForEach( [&] (size_t n) {
+            node_type& leaf = tree.nodes[ n ];
+            box_type box = TriBox( tree.tris[ leaf.first ] );
+            for( uint32_t k = 1; k < leaf.count; k++ ) box = BoxUnion( box, TriBox( tree.tris[ leaf.first + k ] ) );
+            if( BoxEqual( box, leaf.box ) ) return;
+            leaf.box = box;
+
+            for( uint32_t p = tree.parents[ n ]; p != NodeEnd; p = tree.parents[ p ] )
+            {
+                node_type& parent = tree.nodes[ p ];
+                const box_type grown = BoxUnion( tree.nodes[ parent.first ].box, tree.nodes[ parent.first + 1 ].box );
+                if( BoxEqual( grown, parent.box ) ) break;
+                tree.area += BoxArea( grown ) - BoxArea( parent.box );
+                parent.box = grown;
+            }
+        } );
+        touchedLeaves.Clear();
+    }
+    touchedTris.Clear();
+
+    if( !pRebuild && TreeCost( tree ) > kRebuildCost * builtCost ) Rebuild();
+}
+
+// copies the tri boxes then builds from them in the background, where Adopt() polls for it
+void CBvh::Rebuild()
+{
+    struct job_type
+    {
+        std::shared_ptr<rebuild_type> pRebuild;
+        std::shared_ptr<std::vector<box_type>> pBoxes;
+        void operator()() { Build( pRebuild->tree, *pBoxes ); pBoxes.reset(); }
+    };
+
+    job_type job = { std::make_shared<rebuild_type>(), std::make_shared<std::vector<box_type>>() };
+    TriBoxes( *job.pBoxes );
+
+    pRebuild = job.pRebuild;
+    rebuildTris.Clear();
+    rebuilds++;
+
+#ifdef CHATTY
+    AppLog::Info(__FILENAME__, "bvh rebuild %u at cost %.2f of %.2f", rebuilds, TreeCost( tree ), builtCost);
+#endif // CHATTY
+
+    AppJobs::Pool().Background( job, &pRebuild->done );
+}
+
+// swaps in a finished build, and has Refit() redo what was touched since its boxes were copied
+void CBvh::Adopt()
+{
+    if( !pRebuild || pRebuild->done.pending > 0 ) return;
+
+    tree.nodes.swap( pRebuild->tree.nodes );
+    tree.parents.swap( pRebuild->tree.parents );
+    tree.tris.swap( pRebuild->tree.tris );
+    tree.triLeaf.swap( pRebuild->tree.triLeaf );
+    tree.area = pRebuild->tree.area;
+    builtCost = TreeCost( tree );
+    pRebuild.reset();
+
+    touchedLeaves.Resize( tree.nodes.size() );
+    rebuildTris.ForEach( [&] (size_t t) { touchedTris.Set( t ); } );
+    rebuildTris.Clear();
+}
+
+void CBvh::IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm::vec3 const &direction)
+{
+    cxt_out.collisionTri = TriIDEnd;
+    cxt_out.collisionBin = BinIDEnd;
+    if( tree.nodes.empty() ) return;
+
+    const glm::vec3 inv = 1.f / direction; // infinite slabs for axis-parallel rays
+    float nearest = std::numeric_limits<float>::max();
+
+    // where the ray enters the box, or max when it misses or the box is past the nearest hit
+    auto fnEnter = [&] (const box_type& box) -> float
+    {
+        const glm::vec3 t0 = ( box.lo - position ) * inv, t1 = ( box.hi - position ) * inv;
+        const glm::vec3 tNear = glm::min( t0, t1 ), tFar = glm::max( t0, t1 );
+        const float enter = std::max( std::max( tNear.x, tNear.y ), std::max( tNear.z, 0.f ) );
+        const float leave = std::min( std::min( tFar.x, tFar.y ), std::min( tFar.z, nearest ) );
+        return enter <= leave ? enter : std::numeric_limits<float>::max();
+    };
+
+    // nearer child first, so the nearest hit is found early and culls the rest
+    uint32_t stack[ 64 ];
+    uint depth = 0;
+    if( fnEnter( tree.nodes[0].box ) < nearest ) stack[ depth++ ] = 0;
+    while( depth > 0 )
+    {
+        const node_type& node = tree.nodes[ stack[ --depth ] ];
+        if( node.count > 0 )
+        {
+            for( uint32_t k = 0; k < node.count; k++ )
+            {
+                const triID_type triID = tree.tris[ node.first + k ];
+                glm::vec3 v0, v1, v2;
+                pTriangular->GetTriVerts(v0, v1, v2, triID);
+
+                // requires glm-0.9.7.6. x,y are barycentrics and z the distance along the ray
+                glm::vec3 baryPosition;
+                if( !glm::intersectRayTriangle<glm::vec3>( position, direction, v0, v1, v2, baryPosition ) ) continue;
+                if( baryPosition.z >= nearest ) continue;
+
+                nearest = baryPosition.z;
+                cxt_out.collisionTri = triID;
+                cxt_out.collisionBary = glm::vec2( baryPosition );
+                cxt_out.collisionDist = baryPosition.z;
+            }
+            continue;
+        }
+
+        const float enterL = fnEnter( tree.nodes[ node.first ].box ), enterR = fnEnter( tree.nodes[ node.first + 1 ].box );
+        const uint32_t near = enterL <= enterR ? node.first : node.first + 1;
+        const float enterFar = std::max( enterL, enterR );
+        assert( depth + 2 <= 64 );
+        if( enterFar < nearest ) stack[ depth++ ] = near == node.first ? node.first + 1 : node.first;
+        if( std::min( enterL, enterR ) < nearest ) stack[ depth++ ] = near;
+    }
+}
+
+// one walk of the tree for the packet. a node is opened when any ray enters it before that ray's
+// nearest hit, and each tri in it is read once for all of the rays
+void CBvh::IdentifyTris(trisearch_type* cxts_out, const trisearch_type& cxt, glm::vec3 const &position, const glm::vec3* directions, uint n)
+{
+    for( uint r = 0; r < n; r++ )
+    {
+        cxts_out[ r ] = cxt;
+        cxts_out[ r ].collisionTri = TriIDEnd;
+        cxts_out[ r ].collisionBin = BinIDEnd;
+    }
+    if( tree.nodes.empty() || n == 0 ) return;
+
+    packetInvs.resize( n );
+    for( uint r = 0; r < n; r++ ) packetInvs[ r ] = 1.f / directions[ r ];
+    packetNearest.assign( n, std::numeric_limits<float>::max() );
+
+    // where the first of the rays enters the box, or max when none do before their nearest hits
+    auto fnEnter = [&] (const box_type& box) -> float
+    {
+        float first = std::numeric_limits<float>::max();
+        for( uint r = 0; r < n; r++ )
+        {
+            const glm::vec3 t0 = ( box.lo - position ) * packetInvs[ r ], t1 = ( box.hi - position ) * packetInvs[ r ];
+            const glm::vec3 tNear = glm::min( t0, t1 ), tFar = glm::max( t0, t1 );
+            const float enter = std::max( std::max( tNear.x, tNear.y ), std::max( tNear.z, 0.f ) );
+            const float leave = std::min( std::min( tFar.x, tFar.y ), std::min( tFar.z, packetNearest[ r ] ) );
+            if( enter <= leave ) first = std::min( first, enter );
+        }
+        return first;
+    };
+
+    uint32_t stack[ 64 ];
+    uint depth = 0;
+    if( fnEnter( tree.nodes[0].box ) < std::numeric_limits<float>::max() ) stack[ depth++ ] = 0;
+    while( depth > 0 )
+    {
+        const node_type& node = tree.nodes[ stack[ --depth ] ];
+        if( node.count > 0 )
+        {
+            for( uint32_t k = 0; k < node.count; k++ )
+            {
+                const triID_type triID = tree.tris[ node.first + k ];
+                glm::vec3 v0, v1, v2;
+                pTriangular->GetTriVerts(v0, v1, v2, triID);
+
+                for( uint r = 0; r < n; r++ )
+                {
+                    // requires glm-0.9.7.6. x,y are barycentrics and z the distance along the ray
+                    glm::vec3 baryPosition;
+                    if( !glm::intersectRayTriangle<glm::vec3>( position, directions[ r ], v0, v1, v2, baryPosition ) ) continue;
+                    if( baryPosition.z >= packetNearest[ r ] ) continue;
+
+                    packetNearest[ r ] = baryPosition.z;
+                    cxts_out[ r ].collisionTri = triID;
+                    cxts_out[ r ].collisionBary = glm::vec2( baryPosition );
+                    cxts_out[ r ].collisionDist = baryPosition.z;
+                }
+            }
+            continue;
+        }
+
+        const float enterL = fnEnter( tree.nodes[ node.first ].box ), enterR = fnEnter( tree.nodes[ node.first + 1 ].box );
+        const uint32_t near = enterL <= enterR ? node.first : node.first + 1;
+        assert( depth + 2 <= 64 );
+        if( std::max( enterL, enterR ) < std::numeric_limits<float>::max() ) stack[ depth++ ] = near == node.first ? node.first + 1 : node.first;
+        if( std::min( enterL, enterR ) < std::numeric_limits<float>::max() ) stack[ depth++ ] = near;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef _CBVH_HPP_
+#define _CBVH_HPP_
+
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <unistd.h>
+#include <vector>
+#include <memory>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+
+#include "AppTypes.hpp"
+#include "AppJobs.hpp"
+
+// A bounding volume hierarchy of tri boxes, for nearest-hit picking.
+// Brushing marks tris with Touch() and Refit() grows and shrinks the boxes up from just their
+// leaves. Refits loosen the tree as tris move, so when it gets too loose a new tree is built
+// from a copy of the tri boxes in the background, and adopted by the next Refit() that sees it done.
+struct CBvh : public IIdentifyTri
+{
+    struct box_type
+    {
+        glm::vec3 lo, hi;
+    };
+
+    // count tris from tris[first] in a leaf, else first is the left child and the right follows it.
+    // children come after their parents
+    struct node_type
+    {
+        box_type box;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct tree_type
+    {
+        std::vector<node_type> nodes;
+        std::vector<uint32_t> parents; // [0] is the root's, NodeEnd
+        std::vector<triID_type> tris; // by leaf
+        std::vector<uint32_t> triLeaf; // by triID
+        float area = 0.f; // of the internal nodes. over the root's it is the cost of a ray that hits the root
+    };
+
+    static const uint32_t NodeEnd = ~uint32_t(0);
+
+    tree_type tree;
+    float builtCost = 0.f; // as the tree was built, to tell how far refits have loosened it
+
+    dirtybits_type touchedTris; // since the last Refit()
+    dirtybits_type touchedLeaves;
+
+    // a tree being built in the background, and the tris touched since its boxes were copied
+    struct rebuild_type
+    {
+        tree_type tree;
+        AppJobs::counter_type done;
+    };
+    std::shared_ptr<rebuild_type> pRebuild;
+    dirtybits_type rebuildTris;
+    uint rebuilds = 0;
+
+    // scratch for IdentifyTris()
+    std::vector<glm::vec3> packetInvs;
+    std::vector<float> packetNearest;
+
+    IDefineTri* pTriangular = 0;
+
+    CBvh() = default;
+    virtual ~CBvh() = default;
+
+    void Bind(IDefineTri* p);
+    void Release();
+
+    void Reset(); // builds in the foreground
+
+    void Touch(triID_type triID) { touchedTris.Set( triID ); if( pRebuild ) rebuildTris.Set( triID ); }
+    void Refit();
+    void Refit(const dirtybits_type& movedTris) { movedTris.ForEach( [&] (size_t t) { Touch( triID_type( t ) ); } ); Refit(); }
+
+    // IIdentifyTri
+    void IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm::vec3 const &direction) final;
+    void IdentifyTris(trisearch_type* cxts_out, const trisearch_type& cxt, glm::vec3 const &position, const glm::vec3* directions, uint n) final;
+
+private:
+    box_type TriBox(triID_type triID);
+    void TriBoxes(std::vector<box_type>& boxes_out);
+    static void Build(tree_type& tree_out, const std::vector<box_type>& triBoxes);
+    void Rebuild();
+    void Adopt();
+};
+
+#endif //_CBVH_HPP_
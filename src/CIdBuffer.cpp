@@ -0,0 +1,291 @@
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "GL9.hpp"
+
+#include "CIdBuffer.hpp"
+#include "TriTools.hpp"
+#include "AppLog.hpp"
+
+#define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
+
+//#define CHATTY
+
+const int CIdBuffer::PixelSize;
+const int CIdBuffer::TileSize;
+
+const uint kWalkSteps = 32; // from the tri under a buffer pixel to the one the ray hits
+const float kFoldSlope = 2.f; // depth over width, past which a nearer pixel is taken for a fold in front
+
+inline float Cross2(const glm::vec2& a, const glm::vec2& b) { return a.x * b.y - a.y * b.x; }
+
+inline bool RectEmpty(const CIdBuffer::rect_type& r) { return r.x0 > r.x1; }
+
+void CIdBuffer::Bind(IDefineTri* p)
+{
+    pTriangular = p;
+    Reset();
+}
+
+void CIdBuffer::Release()
+{
+    pixelTris.clear();
+    pixelDepths.clear();
+    triRects.clear();
+    tileTris.clear();
+    touchedTris.Resize( 0 );
+    staleTiles.Resize( 0 );
+    width = height = tilesWide = tilesHigh = 0;
+    viewStale = true;
+    pTriangular = 0;
+}
+
+void CIdBuffer::Reset()
+{
+    const size_t nTris = pTriangular->GetIndTris().size();
+    triRects.assign( nTris, { 0, 0, -1, -1 } );
+    touchedTris.Resize( nTris );
+    viewStale = true;
+}
+
+void CIdBuffer::SetView(const glm::mat4& view, const glm::mat4& proj, const glm::vec4& viewport)
+{
+    if( view == mxView && proj == mxProj && viewport == boxViewport ) return;
+
+    mxView = view;
+    mxProj = proj;
+    mxViewProj = proj * view;
+    boxViewport = viewport;
+    viewStale = true;
+}
+
+// as glm::project has it, scaled down to buffer pixels
+glm::vec3 CIdBuffer::Project(const glm::vec3& pos) const
+{
+    const glm::vec4 clip = mxViewProj * glm::vec4( pos, 1.f );
+    if( !( clip.w > std::numeric_limits<float>::epsilon() ) ) return glm::vec3( 0.f, 0.f, 2.f );
+
+    const glm::vec3 ndc = glm::vec3( clip ) / clip.w;
+    return glm::vec3(
+        ( boxViewport.x + ( ndc.x * .5f + .5f ) * boxViewport.z ) / float( PixelSize ),
+        ( boxViewport.y + ( ndc.y * .5f + .5f ) * boxViewport.w ) / float( PixelSize ),
+        ndc.z
+    );
+}
+
+// from the eye, along the view axis, as glm::perspective has it
+float CIdBuffer::EyeDepth(float depth) const
+{
+    return mxProj[3][2] / ( depth + mxProj[2][2] );
+}
+
+// empty for tris that face away or are edge-on, or aren't between the near and far planes
+CIdBuffer::rect_type CIdBuffer::TriRect(triID_type triID) const
+{
+    const rect_type empty = { 0, 0, -1, -1 };
+
+    glm::vec3 v0, v1, v2;
+    pTriangular->GetTriVerts( v0, v1, v2, triID );
+    const glm::vec3 a = Project( v0 ), b = Project( v1 ), c = Project( v2 );
+    if( std::fabs( a.z ) > 1.f || std::fabs( b.z ) > 1.f || std::fabs( c.z ) > 1.f ) return empty;
+    if( !( Cross2( glm::vec2( b - a ), glm::vec2( c - a ) ) > 0.f ) ) return empty;
+
+    // pixel i's centre is at i + .5
+    const glm::vec2 lo = glm::min( glm::vec2( a ), glm::min( glm::vec2( b ), glm::vec2( c ) ) );
+    const glm::vec2 hi = glm::max( glm::vec2( a ), glm::max( glm::vec2( b ), glm::vec2( c ) ) );
+    const int x0 = std::max( 0, int( std::ceil( lo.x - .5f ) ) ), x1 = std::min( width - 1, int( std::floor( hi.x - .5f ) ) );
+    const int y0 = std::max( 0, int( std::ceil( lo.y - .5f ) ) ), y1 = std::min( height - 1, int( std::floor( hi.y - .5f ) ) );
+    if( x0 > x1 || y0 > y1 ) return empty;
+
+    return { int16_t( x0 ), int16_t( y0 ), int16_t( x1 ), int16_t( y1 ) };
+}
+
+// clears the tile and draws the tris listed on it that still cover it
+void CIdBuffer::Rasterize(size_t tile)
+{
+    const int tx0 = int( tile % tilesWide ) * TileSize, ty0 = int( tile / tilesWide ) * TileSize;
+    const int tx1 = std::min( width, tx0 + TileSize ) - 1, ty1 = std::min( height, ty0 + TileSize ) - 1;
+
+    for( int y = ty0; y <= ty1; y++ )
+    {
+        std::fill( pixelTris.begin() + y * width + tx0, pixelTris.begin() + y * width + tx1 + 1, TriIDEnd );
+        std::fill( pixelDepths.begin() + y * width + tx0, pixelDepths.begin() + y * width + tx1 + 1, std::numeric_limits<float>::max() );
+    }
+
+    std::vector<triID_type>& tris = tileTris[ tile ];
+    size_t kept = 0;
+    for( triID_type triID : tris )
+    {
+        const rect_type& r = triRects[ triID ];
+        const int x0 = std::max<int>( r.x0, tx0 ), x1 = std::min<int>( r.x1, tx1 );
+        const int y0 = std::max<int>( r.y0, ty0 ), y1 = std::min<int>( r.y1, ty1 );
+        if( x0 > x1 || y0 > y1 ) continue; // moved off
+        tris[ kept++ ] = triID;
+
+        glm::vec3 v0, v1, v2;
+        pTriangular->GetTriVerts( v0, v1, v2, triID );
+        const glm::vec3 a = Project( v0 ), b = Project( v1 ), c = Project( v2 );
+        const glm::vec2 ab( b - a ), bc( c - b ), ca( a - c );
+        const float area = Cross2( ab, -ca );
+
+        for( int y = y0; y <= y1; y++ )
+        {
+            for( int x = x0; x <= x1; x++ )
+            {
+                const glm::vec2 p( x + .5f, y + .5f );
+                const float wa = Cross2( bc, p - glm::vec2( b ) ), wb = Cross2( ca, p - glm::vec2( c ) ), wc = Cross2( ab, p - glm::vec2( a ) );
+                if( wa < 0.f || wb < 0.f || wc < 0.f ) continue;
+
+                const float depth = ( wa * a.z + wb * b.z + wc * c.z ) / area;
+                const size_t i = size_t( y ) * width + x;
+                if( depth < pixelDepths[ i ] )
+                {
+                    pixelDepths[ i ] = depth;
+                    pixelTris[ i ] = triID;
+                }
+            }
+        }
+    }
+    tris.resize( kept );
+}
+
+void CIdBuffer::Rebuild()
+{
+    AppJobs& jobs = AppJobs::Pool();
+
+    width = int( std::ceil( boxViewport.z / PixelSize ) );
+    height = int( std::ceil( boxViewport.w / PixelSize ) );
+    tilesWide = ( width + TileSize - 1 ) / TileSize;
+    tilesHigh = ( height + TileSize - 1 ) / TileSize;
+    pixelTris.resize( size_t( width ) * height );
+    pixelDepths.resize( size_t( width ) * height );
+
+    const size_t nTiles = size_t( tilesWide ) * tilesHigh;
+    tileTris.resize( nTiles );
+    for( auto& tris : tileTris ) tris.clear(); // keeps their capacity
+    staleTiles.Resize( nTiles );
+
+    jobs.ParallelFor( 0, triRects.size(), 4096, [&] (size_t first, size_t end) {
+        for( size_t t = first; t < end; t++ ) triRects[ t ] = TriRect( triID_type( t ) );
+    } );
+    for( size_t t = 0; t < triRects.size(); t++ )
+    {
+        const rect_type& r = triRects[ t ];
+        if( RectEmpty( r ) ) continue;
+        for( int ty = r.y0 / TileSize; ty <= r.y1 / TileSize; ty++ )
+            for( int tx = r.x0 / TileSize; tx <= r.x1 / TileSize; tx++ )
+                tileTris[ size_t( ty ) * tilesWide + tx ].push_back( triID_type( t ) );
+    }
+
+    jobs.ParallelFor( 0, nTiles, 4, [&] (size_t first, size_t end) {
+        for( size_t tile = first; tile < end; tile++ ) Rasterize( tile );
+    } );
+
+    touchedTris.Clear();
+    viewStale = false;
+
+#ifdef CHATTY
+    AppLog::Info(__FILENAME__, "id buffer %dx%d, %zu tiles\n", width, height, nTiles);
+#endif
+}
+
+// the tiles a touched tri covered and covers are re-rasterized. it's listed on the ones it moved onto
+void CIdBuffer::Refresh()
+{
+    if( !touchedTris.Any() ) return;
+
+    touchedTris.ForEach( [&] (size_t t) {
+        const rect_type was = triRects[ t ], now = TriRect( triID_type( t ) );
+        triRects[ t ] = now;
+
+        if( !RectEmpty( was ) )
+        {
+            for( int ty = was.y0 / TileSize; ty <= was.y1 / TileSize; ty++ )
+                for( int tx = was.x0 / TileSize; tx <= was.x1 / TileSize; tx++ )
+                    staleTiles.Set( size_t( ty ) * tilesWide + tx );
+        }
+        if( !RectEmpty( now ) )
+        {
+            for( int ty = now.y0 / TileSize; ty <= now.y1 / TileSize; ty++ )
+                for( int tx = now.x0 / TileSize; tx <= now.x1 / TileSize; tx++ )
+                {
+                    const size_t tile = size_t( ty ) * tilesWide + tx;
+                    staleTiles.Set( tile );
+
+                    const bool listed = !RectEmpty( was ) &&
+                        was.x0 / TileSize <= tx && tx <= was.x1 / TileSize && was.y0 / TileSize <= ty && ty <= was.y1 / TileSize;
+                    if( !listed ) tileTris[ tile ].push_back( triID_type( t ) );
+                }
+        }
+    } );
+    touchedTris.Clear();
+
+    refreshTiles.clear();
+    staleTiles.ForEach( [&] (size_t tile) { refreshTiles.push_back( tile ); } );
+    staleTiles.Clear();
+
+    AppJobs::Pool().ParallelFor( 0, refreshTiles.size(), 2, [&] (size_t first, size_t end) {
+        for( size_t i = first; i < end; i++ ) Rasterize( refreshTiles[ i ] );
+    } );
+
+#ifdef CHATTY
+    AppLog::Info(__FILENAME__, "id buffer refreshed %zu tiles\n", refreshTiles.size());
+#endif
+}
+
+// the tri under the ray's pixel is near the one it hits, if not the one. at a silhouette the ray's pixel
+// can be empty or hold the tri behind, so walks also start from the pixels around it that are nearer
+// than the nearest hit so far, by more than a slope of kFoldSlope across a pixel
+void CIdBuffer::IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm::vec3 const &direction)
+{
+    cxt_out.collisionTri = TriIDEnd;
+    cxt_out.collisionBin = BinIDEnd;
+    if( !pTriangular || !( boxViewport.z > 0.f && boxViewport.w > 0.f ) ) return;
+
+    if( viewStale ) Rebuild();
+    else Refresh();
+
+    const glm::vec3 at = Project( position + direction );
+    if( at.z > 1.f ) return; // behind the eye
+    const int x = int( std::floor( at.x ) ), y = int( std::floor( at.y ) );
+
+    static const int around[9][2] = { {0,0}, {1,0}, {-1,0}, {0,1}, {0,-1}, {1,1}, {-1,1}, {1,-1}, {-1,-1} };
+    triID_type tried[9];
+    uint nTried = 0;
+    const float pixelAngle = 2.f * PixelSize / ( mxProj[1][1] * boxViewport.w ); // as seen from the eye, about
+    float nearest = std::numeric_limits<float>::max(); // eye depth, less the margin
+    trisearch_type cxt = cxt_out;
+    for( auto& d : around )
+    {
+        const int px = x + d[0], py = y + d[1];
+        if( px < 0 || px >= width || py < 0 || py >= height ) continue;
+
+        const size_t i = size_t( py ) * width + px;
+        const triID_type triID = pixelTris[ i ];
+        if( triID == TriIDEnd || !( EyeDepth( pixelDepths[ i ] ) < nearest ) ) continue;
+        if( std::find( tried, tried + nTried, triID ) != tried + nTried ) continue;
+        tried[ nTried++ ] = triID;
+
+        if( !TriWalk( cxt, triID, *pTriangular, position, direction, direction, kWalkSteps ) ) continue;
+        if( cxt_out.IsValid() && !( cxt.collisionDist < cxt_out.collisionDist ) ) continue;
+
+        cxt_out = cxt;
+        const float depth = EyeDepth( Project( position + direction * cxt.collisionDist ).z );
+        nearest = depth * ( 1.f - kFoldSlope * pixelAngle );
+    }
+}
+
+void CIdBuffer::IdentifyTris(trisearch_type* cxts_out, const trisearch_type& cxt, glm::vec3 const &position, const glm::vec3* directions, uint n)
+{
+    for( uint r = 0; r < n; r++ )
+    {
+        cxts_out[ r ] = cxt;
+        IdentifyTri( cxts_out[ r ], position, directions[ r ] );
+    }
+}
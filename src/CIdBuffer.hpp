@@ -0,0 +1,74 @@
+#ifndef _CIDBUFFER_HPP_
+#define _CIDBUFFER_HPP_
+
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <unistd.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "AppTypes.hpp"
+#include "AppJobs.hpp"
+
+// A low resolution tri id and depth buffer of the view, rasterized on the cpu, so a pick is a lookup
+// and a short walk to the tri the ray hits. Tris are listed by the screen tiles they cover.
+// Brushing marks tris with Touch() and the next pick re-rasterizes just the tiles they covered or
+// now cover. A new view from SetView() rasterizes it all again, also on the next pick.
+// Rays are taken to start at the view's eye, as the brush's and touch's do.
+struct CIdBuffer : public IIdentifyTri
+{
+    static const int PixelSize = 4; // screen pixels per buffer pixel, each way
+    static const int TileSize = 16; // buffer pixels per tile, each way
+
+    // of the pixel centres a tri covers, inclusive. empty when x0 > x1
+    struct rect_type
+    {
+        int16_t x0, y0, x1, y1;
+    };
+
+    glm::mat4 mxView, mxProj, mxViewProj;
+    glm::vec4 boxViewport;
+    bool viewStale = true;
+
+    int width = 0, height = 0; // in buffer pixels
+    int tilesWide = 0, tilesHigh = 0;
+    std::vector<triID_type> pixelTris; // front faces only, as glm::intersectRayTriangle sees
+    std::vector<float> pixelDepths;
+
+    std::vector<rect_type> triRects; // as last rasterized
+    std::vector<std::vector<triID_type>> tileTris; // tris that left a tile are dropped when it's next rasterized
+    dirtybits_type touchedTris; // since the last refresh
+    dirtybits_type staleTiles;
+    std::vector<size_t> refreshTiles; // scratch
+
+    IDefineTri* pTriangular = 0;
+
+    CIdBuffer() = default;
+    virtual ~CIdBuffer() = default;
+
+    void Bind(IDefineTri* p);
+    void Release();
+
+    void Reset(); // rasterizes it all on the next pick
+    void SetView(const glm::mat4& view, const glm::mat4& proj, const glm::vec4& viewport);
+
+    void Touch(triID_type triID) { touchedTris.Set( triID ); }
+    void Refit(const dirtybits_type& movedTris) { movedTris.ForEach( [&] (size_t t) { Touch( triID_type( t ) ); } ); }
+
+    // IIdentifyTri
+    void IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm::vec3 const &direction) final;
+    void IdentifyTris(trisearch_type* cxts_out, const trisearch_type& cxt, glm::vec3 const &position, const glm::vec3* directions, uint n) final;
+
+private:
+    glm::vec3 Project(const glm::vec3& pos) const; // to buffer pixels and depth, z past 1 when behind the eye
+    float EyeDepth(float depth) const;
+    rect_type TriRect(triID_type triID) const;
+    void Rasterize(size_t tile);
+    void Rebuild();
+    void Refresh();
+};
+
+#endif //_CIDBUFFER_HPP_
@@ -0,0 +1,261 @@
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RAYTRIS_X86
+#endif
+
+#include "CRayTris.hpp"
+
+//#define RAYTRIS_SCALAR // to compare against
+
+const uint32_t CRayTris::NoHit;
+const size_t CRayTris::Pad;
+
+const uint kRays = 32; // NearestHits() runs the kernel on this many at a time
+
+using kernel_type = uint (*)(const float* const planes[], uint32_t count, const glm::vec3& orig, const glm::vec3* dirs, uint n, uint32_t* hits_out, glm::vec3* barys_out, bool nearest);
+
+// each is glm::intersectRayTriangle, op for op, over a block of tris at a time:
+//   p = cross(dir, e2), a = dot(e1, p), miss when a < epsilon, f = 1 / a
+//   s = orig - v0, u = f * dot(s, p), q = cross(s, e1), v = f * dot(dir, q), t = f * dot(e2, q)
+//   hit when 0 <= u <= 1, 0 <= v, u + v <= 1 and 0 <= t
+// where s and q don't depend upon the ray's direction, so a packet shares them.
+// first hits skip rays that have one. nearest hits keep looking, for hits nearer than barys_out's z
+// with ties going to the earlier tri. either way they return how many hits they changed
+// nb: nan fails the ordered compares, where glm gets to the same miss by a longer route
+
+#if !defined(RAYTRIS_X86) || defined(RAYTRIS_SCALAR)
+
+static uint KernelScalar(const float* const planes[], uint32_t count, const glm::vec3& orig, const glm::vec3* dirs, uint n, uint32_t* hits_out, glm::vec3* barys_out, bool nearest)
+{
+    const float eps = std::numeric_limits<float>::epsilon();
+    uint open = n, changed = 0;
+    for( uint32_t k = 0; k < count && open > 0; k++ )
+    {
+        const glm::vec3 v0( planes[0][k], planes[1][k], planes[2][k] );
+        const glm::vec3 e1( planes[3][k], planes[4][k], planes[5][k] );
+        const glm::vec3 e2( planes[6][k], planes[7][k], planes[8][k] );
+        const glm::vec3 s = orig - v0;
+        const glm::vec3 q = glm::cross( s, e1 );
+
+        for( uint r = 0; r < n; r++ )
+        {
+            if( !nearest && hits_out[ r ] != CRayTris::NoHit ) continue;
+            const glm::vec3 p = glm::cross( dirs[ r ], e2 );
+            const float a = glm::dot( e1, p );
+            if( !( a >= eps ) ) continue;
+            const float f = 1.f / a;
+            const float u = f * glm::dot( s, p );
+            const float v = f * glm::dot( dirs[ r ], q );
+            const float t = f * glm::dot( e2, q );
+            if( !( u >= 0.f && u <= 1.f && v >= 0.f && u + v <= 1.f && t >= 0.f ) ) continue;
+            if( nearest && !( t < barys_out[ r ].z ) ) continue;
+            hits_out[ r ] = k;
+            barys_out[ r ] = glm::vec3( u, v, t );
+            changed++;
+            if( !nearest ) open--;
+        }
+    }
+    return changed;
+}
+
+#endif // !RAYTRIS_X86 || RAYTRIS_SCALAR
+
+#if defined(RAYTRIS_X86)
+
+static uint KernelSSE(const float* const planes[], uint32_t count, const glm::vec3& orig, const glm::vec3* dirs, uint n, uint32_t* hits_out, glm::vec3* barys_out, bool nearest)
+{
+    const __m128 eps = _mm_set1_ps( std::numeric_limits<float>::epsilon() );
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps( 1.f );
+    const __m128 ox = _mm_set1_ps( orig.x ), oy = _mm_set1_ps( orig.y ), oz = _mm_set1_ps( orig.z );
+
+    uint open = n, changed = 0;
+    for( uint32_t k = 0; k < count && open > 0; k += 4 )
+    {
+        const int valid = count - k >= 4 ? 0xF : ( 1 << ( count - k ) ) - 1;
+        const __m128 e1x = _mm_loadu_ps( planes[3] + k ), e1y = _mm_loadu_ps( planes[4] + k ), e1z = _mm_loadu_ps( planes[5] + k );
+        const __m128 e2x = _mm_loadu_ps( planes[6] + k ), e2y = _mm_loadu_ps( planes[7] + k ), e2z = _mm_loadu_ps( planes[8] + k );
+        const __m128 sx = _mm_sub_ps( ox, _mm_loadu_ps( planes[0] + k ) );
+        const __m128 sy = _mm_sub_ps( oy, _mm_loadu_ps( planes[1] + k ) );
+        const __m128 sz = _mm_sub_ps( oz, _mm_loadu_ps( planes[2] + k ) );
+        const __m128 qx = _mm_sub_ps( _mm_mul_ps( sy, e1z ), _mm_mul_ps( e1y, sz ) );
+        const __m128 qy = _mm_sub_ps( _mm_mul_ps( sz, e1x ), _mm_mul_ps( e1z, sx ) );
+        const __m128 qz = _mm_sub_ps( _mm_mul_ps( sx, e1y ), _mm_mul_ps( e1x, sy ) );
+        const __m128 dot2q = _mm_add_ps( _mm_add_ps( _mm_mul_ps( e2x, qx ), _mm_mul_ps( e2y, qy ) ), _mm_mul_ps( e2z, qz ) );
+
+        for( uint r = 0; r < n; r++ )
+        {
+            if( !nearest && hits_out[ r ] != CRayTris::NoHit ) continue;
+            const __m128 dx = _mm_set1_ps( dirs[ r ].x ), dy = _mm_set1_ps( dirs[ r ].y ), dz = _mm_set1_ps( dirs[ r ].z );
+            const __m128 px = _mm_sub_ps( _mm_mul_ps( dy, e2z ), _mm_mul_ps( e2y, dz ) );
+            const __m128 py = _mm_sub_ps( _mm_mul_ps( dz, e2x ), _mm_mul_ps( e2z, dx ) );
+            const __m128 pz = _mm_sub_ps( _mm_mul_ps( dx, e2y ), _mm_mul_ps( e2x, dy ) );
+            const __m128 a = _mm_add_ps( _mm_add_ps( _mm_mul_ps( e1x, px ), _mm_mul_ps( e1y, py ) ), _mm_mul_ps( e1z, pz ) );
+            const __m128 f = _mm_div_ps( one, a );
+            const __m128 u = _mm_mul_ps( f, _mm_add_ps( _mm_add_ps( _mm_mul_ps( sx, px ), _mm_mul_ps( sy, py ) ), _mm_mul_ps( sz, pz ) ) );
+            const __m128 v = _mm_mul_ps( f, _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, qx ), _mm_mul_ps( dy, qy ) ), _mm_mul_ps( dz, qz ) ) );
+            const __m128 t = _mm_mul_ps( f, dot2q );
+
+            __m128 hit = _mm_cmpge_ps( a, eps );
+            hit = _mm_and_ps( hit, _mm_and_ps( _mm_cmpge_ps( u, zero ), _mm_cmple_ps( u, one ) ) );
+            hit = _mm_and_ps( hit, _mm_and_ps( _mm_cmpge_ps( v, zero ), _mm_cmple_ps( _mm_add_ps( u, v ), one ) ) );
+            hit = _mm_and_ps( hit, _mm_cmpge_ps( t, zero ) );
+            if( nearest ) hit = _mm_and_ps( hit, _mm_cmplt_ps( t, _mm_set1_ps( barys_out[ r ].z ) ) );
+            int lanes = _mm_movemask_ps( hit ) & valid;
+            if( !lanes ) continue;
+
+            float us[4], vs[4], ts[4];
+            _mm_storeu_ps( us, u );
+            _mm_storeu_ps( vs, v );
+            _mm_storeu_ps( ts, t );
+            int lane = __builtin_ctz( lanes );
+            if( nearest )
+                for( lanes &= lanes - 1; lanes; lanes &= lanes - 1 )
+                    if( ts[ __builtin_ctz( lanes ) ] < ts[ lane ] ) lane = __builtin_ctz( lanes );
+            hits_out[ r ] = k + lane;
+            barys_out[ r ] = glm::vec3( us[ lane ], vs[ lane ], ts[ lane ] );
+            changed++;
+            if( !nearest ) open--;
+        }
+    }
+    return changed;
+}
+
+// no fma, which would round differently from glm
+__attribute__((target("avx2")))
+static uint KernelAVX2(const float* const planes[], uint32_t count, const glm::vec3& orig, const glm::vec3* dirs, uint n, uint32_t* hits_out, glm::vec3* barys_out, bool nearest)
+{
+    const __m256 eps = _mm256_set1_ps( std::numeric_limits<float>::epsilon() );
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps( 1.f );
+    const __m256 ox = _mm256_set1_ps( orig.x ), oy = _mm256_set1_ps( orig.y ), oz = _mm256_set1_ps( orig.z );
+
+    uint open = n, changed = 0;
+    for( uint32_t k = 0; k < count && open > 0; k += 8 )
+    {
+        const int valid = count - k >= 8 ? 0xFF : ( 1 << ( count - k ) ) - 1;
+        const __m256 e1x = _mm256_loadu_ps( planes[3] + k ), e1y = _mm256_loadu_ps( planes[4] + k ), e1z = _mm256_loadu_ps( planes[5] + k );
+        const __m256 e2x = _mm256_loadu_ps( planes[6] + k ), e2y = _mm256_loadu_ps( planes[7] + k ), e2z = _mm256_loadu_ps( planes[8] + k );
+        const __m256 sx = _mm256_sub_ps( ox, _mm256_loadu_ps( planes[0] + k ) );
+        const __m256 sy = _mm256_sub_ps( oy, _mm256_loadu_ps( planes[1] + k ) );
+        const __m256 sz = _mm256_sub_ps( oz, _mm256_loadu_ps( planes[2] + k ) );
+        const __m256 qx = _mm256_sub_ps( _mm256_mul_ps( sy, e1z ), _mm256_mul_ps( e1y, sz ) );
+        const __m256 qy = _mm256_sub_ps( _mm256_mul_ps( sz, e1x ), _mm256_mul_ps( e1z, sx ) );
+        const __m256 qz = _mm256_sub_ps( _mm256_mul_ps( sx, e1y ), _mm256_mul_ps( e1x, sy ) );
+        const __m256 dot2q = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( e2x, qx ), _mm256_mul_ps( e2y, qy ) ), _mm256_mul_ps( e2z, qz ) );
+
+        for( uint r = 0; r < n; r++ )
+        {
+            if( !nearest && hits_out[ r ] != CRayTris::NoHit ) continue;
+            const __m256 dx = _mm256_set1_ps( dirs[ r ].x ), dy = _mm256_set1_ps( dirs[ r ].y ), dz = _mm256_set1_ps( dirs[ r ].z );
+            const __m256 px = _mm256_sub_ps( _mm256_mul_ps( dy, e2z ), _mm256_mul_ps( e2y, dz ) );
+            const __m256 py = _mm256_sub_ps( _mm256_mul_ps( dz, e2x ), _mm256_mul_ps( e2z, dx ) );
+            const __m256 pz = _mm256_sub_ps( _mm256_mul_ps( dx, e2y ), _mm256_mul_ps( e2x, dy ) );
+            const __m256 a = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( e1x, px ), _mm256_mul_ps( e1y, py ) ), _mm256_mul_ps( e1z, pz ) );
+            const __m256 f = _mm256_div_ps( one, a );
+            const __m256 u = _mm256_mul_ps( f, _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( sx, px ), _mm256_mul_ps( sy, py ) ), _mm256_mul_ps( sz, pz ) ) );
+            const __m256 v = _mm256_mul_ps( f, _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( dx, qx ), _mm256_mul_ps( dy, qy ) ), _mm256_mul_ps( dz, qz ) ) );
+            const __m256 t = _mm256_mul_ps( f, dot2q );
+
+            __m256 hit = _mm256_cmp_ps( a, eps, _CMP_GE_OQ );
+            hit = _mm256_and_ps( hit, _mm256_and_ps( _mm256_cmp_ps( u, zero, _CMP_GE_OQ ), _mm256_cmp_ps( u, one, _CMP_LE_OQ ) ) );
+            hit = _mm256_and_ps( hit, _mm256_and_ps( _mm256_cmp_ps( v, zero, _CMP_GE_OQ ), _mm256_cmp_ps( _mm256_add_ps( u, v ), one, _CMP_LE_OQ ) ) );
+            hit = _mm256_and_ps( hit, _mm256_cmp_ps( t, zero, _CMP_GE_OQ ) );
+            if( nearest ) hit = _mm256_and_ps( hit, _mm256_cmp_ps( t, _mm256_set1_ps( barys_out[ r ].z ), _CMP_LT_OQ ) );
+            int lanes = _mm256_movemask_ps( hit ) & valid;
+            if( !lanes ) continue;
+
+            float us[8], vs[8], ts[8];
+            _mm256_storeu_ps( us, u );
+            _mm256_storeu_ps( vs, v );
+            _mm256_storeu_ps( ts, t );
+            int lane = __builtin_ctz( lanes );
+            if( nearest )
+                for( lanes &= lanes - 1; lanes; lanes &= lanes - 1 )
+                    if( ts[ __builtin_ctz( lanes ) ] < ts[ lane ] ) lane = __builtin_ctz( lanes );
+            hits_out[ r ] = k + lane;
+            barys_out[ r ] = glm::vec3( us[ lane ], vs[ lane ], ts[ lane ] );
+            changed++;
+            if( !nearest ) open--;
+        }
+    }
+    return changed;
+}
+
+#endif // RAYTRIS_X86
+
+static const char* kernelName = "scalar";
+
+static kernel_type PickKernel()
+{
+#if defined(RAYTRIS_X86) && !defined(RAYTRIS_SCALAR)
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) ) { kernelName = "avx2"; return KernelAVX2; }
+    kernelName = "sse";
+    return KernelSSE;
+#else
+    return KernelScalar;
+#endif
+}
+
+static kernel_type Kernel()
+{
+    static const kernel_type fnKernel = PickKernel();
+    return fnKernel;
+}
+
+const char* CRayTris::KernelName() { Kernel(); return kernelName; }
+
+void CRayTris::Resize(size_t slots)
+{
+    for( auto& plane : planes ) plane.resize( slots + Pad, 0.f );
+}
+
+void CRayTris::Set(size_t slot, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+{
+    const glm::vec3 e1 = v1 - v0, e2 = v2 - v0;
+    planes[ V0X ][ slot ] = v0.x; planes[ V0Y ][ slot ] = v0.y; planes[ V0Z ][ slot ] = v0.z;
+    planes[ E1X ][ slot ] = e1.x; planes[ E1Y ][ slot ] = e1.y; planes[ E1Z ][ slot ] = e1.z;
+    planes[ E2X ][ slot ] = e2.x; planes[ E2Y ][ slot ] = e2.y; planes[ E2Z ][ slot ] = e2.z;
+}
+
+void CRayTris::FirstHits(size_t first, uint32_t count, const glm::vec3& orig, const glm::vec3* dirs, uint n, uint32_t* hits_out, glm::vec3* barys_out) const
+{
+    std::fill( hits_out, hits_out + n, NoHit );
+    if( count == 0 || n == 0 ) return;
+
+    const float* p[ PlaneCount ];
+    for( int i = 0; i < PlaneCount; i++ ) p[i] = planes[i].data() + first;
+    Kernel()( p, count, orig, dirs, n, hits_out, barys_out, false );
+}
+
+uint CRayTris::NearestHits(size_t first, uint32_t count, const glm::vec3& orig, const glm::vec3* dirs, uint n, uint32_t* slots_inout, glm::vec3* barys_inout) const
+{
+    if( count == 0 || n == 0 ) return 0;
+
+    // the kernel's hits are from first, so they're kept apart from the slots hit in earlier rows
+    uint32_t hits[ kRays ];
+    const float* p[ PlaneCount ];
+    for( int i = 0; i < PlaneCount; i++ ) p[i] = planes[i].data() + first;
+
+    uint changed = 0;
+    for( uint r0 = 0; r0 < n; r0 += kRays )
+    {
+        const uint m = std::min( n - r0, kRays );
+        std::fill( hits, hits + m, NoHit );
+        if( !Kernel()( p, count, orig, dirs + r0, m, hits, barys_inout + r0, true ) ) continue;
+        for( uint r = 0; r < m; r++ )
+        {
+            if( hits[ r ] == NoHit ) continue;
+            slots_inout[ r0 + r ] = uint32_t( first ) + hits[ r ];
+            changed++;
+        }
+    }
+    return changed;
+}
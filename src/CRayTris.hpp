@@ -0,0 +1,47 @@
+#ifndef _CRAYTRIS_HPP_
+#define _CRAYTRIS_HPP_
+
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+#include <unistd.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/vec3.hpp>
+
+// Tris kept a coord per plane, for testing rays against runs of them 8 or 4 at a time.
+// The kernel is AVX2 or SSE as the cpu allows, else scalar, and all of them do the same float ops
+// as glm::intersectRayTriangle so they agree with it on which tris are hit.
+struct CRayTris
+{
+    static const uint32_t NoHit = ~uint32_t(0);
+    static const size_t Pad = 8; // slots past the end, so kernels can read whole blocks
+
+    // by slot: v0, e1 = v1 - v0 and e2 = v2 - v0
+    enum plane_type { V0X, V0Y, V0Z, E1X, E1Y, E1Z, E2X, E2Y, E2Z, PlaneCount };
+    std::vector<float> planes[ PlaneCount ];
+
+    size_t Slots() const { return planes[0].size() < Pad ? 0 : planes[0].size() - Pad; }
+    void Resize(size_t slots); // keeps what's there
+    void Set(size_t slot, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+
+    // for each of n rays from orig, the first of the count tris from first that it hits, or NoHit.
+    // a packet of rays shares each block's loads and the parts of the test that don't depend upon direction.
+    // bary is as glm::intersectRayTriangle has it: barycentrics in x,y and distance in z
+    void FirstHits(size_t first, uint32_t count, const glm::vec3& orig, const glm::vec3* dirs, uint n, uint32_t* hits_out, glm::vec3* barys_out) const;
+    // for each of n rays from orig, the nearest of the count tris from first that it hits nearer than
+    // barys_inout's z, as a slot. rays without one are left as they were, so a ray can be run over
+    // several rows with z starting out as the farthest to look. returns how many hits changed
+    uint NearestHits(size_t first, uint32_t count, const glm::vec3& orig, const glm::vec3* dirs, uint n, uint32_t* slots_inout, glm::vec3* barys_inout) const;
+
+    uint32_t FirstHit(size_t first, uint32_t count, const glm::vec3& orig, const glm::vec3& dir, glm::vec3& bary_out) const
+    {
+        uint32_t hit;
+        FirstHits( first, count, orig, &dir, 1, &hit, &bary_out );
+        return hit;
+    }
+
+    static const char* KernelName();
+};
+
+#endif //_CRAYTRIS_HPP_
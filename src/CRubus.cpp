@@ -6,17 +6,18 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <set>
-#include <map>
-#include <list>
+#include <limits>
 #include <algorithm>
 #include <functional>
+#include <numeric>
 
 #include "GL9.hpp"
 
 #include "TriTools.hpp"
 #include "CRubus.hpp"
+#include "RSphere.hpp"
 #include "AppLog.hpp"
+#include "AppJobs.hpp"
 
 #define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
 
@@ -29,289 +30,478 @@ inline float glLength(const glm::vec3& vec)
 //#define ENABLE_COLLISION_FALLBACK
 //#define CHATTY
 
-// whats hacky about this is we assume bin and tri t_id types are each half of uint...
-struct bintri_type
-{
-    union
-    {
-        binID_triID_key key;
-        struct
-        {
-            binID_type bin;
-            triID_type tri;
-        } id;
-    };
-    bintri_type(binID_type b, triID_type t) { id.bin = b; id.tri = t; }
-    inline bool operator<(const bintri_type& other) const { return this->key < other.key; }
-};
+const float kTrisPerBin = 8.f; // roughly, for picking Reset()'s dimension
+
+template<class Mesh>
+const size_t CRubus<Mesh>::PacketRays;
 
-CRubus::CRubus()
+template<class Mesh>
+CRubus<Mesh>::CRubus()
 {
     dimension = 32;
 }
 
-void CRubus::Bind(IDefineTri* p)
+template<class Mesh>
+void CRubus<Mesh>::Bind(Mesh* p)
 {
     pTriagonalnomial = p;
+    Reset();
 
-    std::multimap<binID_type, glm::vec3> binVecs; // use copies here to incl center tri point
-    std::set<binID_type> binNames;
-    std::set<bintri_type> uniqueBinTris;
-    std::list<glm::vec3> centerPoints;
-
-    std::vector<ind3_type>& indTri = pTriagonalnomial->GetIndTris();
-
-    const float a_third( 1.f / 3.f );
-    glm::vec3 v0, v1, v2;
-
-    // ask only for triangles from the renderable
-    for(triID_type triID = 0; triID < indTri.size(); triID++)
-    {
-        pTriagonalnomial->GetTriVerts(v0, v1, v2, triID);
-
-        centerPoints.push_front( (v0 + v1 + v2) * a_third );
-        glm::vec3 & center = centerPoints.front();
+    // so a stroke's packets don't grow the scratch
+    packetSlots.reserve( PacketRays );
+    packetBarys.reserve( PacketRays );
+    packetBins.reserve( PacketRays );
+    packetRows.reserve( binRows.size() );
+}
 
-        binID_type b0 = BinMake( v0, dimension);
-        binID_type b1 = BinMake( v1, dimension);
-        binID_type b2 = BinMake( v2, dimension);
-        binID_type bc = BinMake( center, dimension);
+template<class Mesh>
+void CRubus<Mesh>::Release()
+{
+    binSpheres.clear();
+    binRows.clear();
+    binTriIDs.clear();
+    binSlots = 0;
+    triSerials.clear();
+    triBins.clear();
+    rowTris.Resize( 0 );
+    staleRows.Resize( 0 );
+    rowBounds.clear();
+    blockBounds.clear();
+    staleBlocks.Resize( 0 );
+    resetVecs.clear();
+    resetPairs.clear();
+    resetSorted.clear();
+    resetBinPairs.clear();
+    pTriagonalnomial = 0;
+}
 
-        binVecs.insert( std::make_pair(b0, v0) );
-        binVecs.insert( std::make_pair(b1, v1) );
-        binVecs.insert( std::make_pair(b2, v2) );
-        binVecs.insert( std::make_pair(bc, center) );
+template<class Mesh>
+void CRubus<Mesh>::Reset()
+{
+    AppJobs& jobs = AppJobs::Pool();
 
-        binNames.insert( b0 );
-        binNames.insert( b1 );
-        binNames.insert( b2 );
-        binNames.insert( bc );
+    std::vector<ind3_type>& indTri = pTriagonalnomial->GetIndTris();
 
-        uniqueBinTris.insert( bintri_type(b0, triID) );
-        uniqueBinTris.insert( bintri_type(b1, triID) );
-        uniqueBinTris.insert( bintri_type(b2, triID) );
-        uniqueBinTris.insert( bintri_type(bc, triID) );
+    if( binning == CubeBinning )
+    {
+        // six faces of dimension^2, kept even for CubeBinAdjust()
+        const float dim = std::sqrt( float( indTri.size() ) / kTrisPerBin / 6.f );
+        dimension = uint8_t( uint( std::max( 10.f, std::min( 104.f, dim ) ) ) & ~1u );
     }
-
-    // for each bin, calc center then determine radius
-    for( auto iterBin = binNames.begin(); iterBin != binNames.end(); ++iterBin )
+    else
     {
-        sph_markable sph;
-        sph.radius = 0.f;
-        sph.center = glm::vec3(0);
-        sph.serial = 0;
-
-        Inflate(sph, *iterBin, binVecs);
-
-        binSpheres.insert(std::make_pair(*iterBin,sph));
+        // latitudes only span half the bins, so there are about dimension^2/2 in use
+        const float dim = std::sqrt( 2.f * float( indTri.size() ) / kTrisPerBin );
+        dimension = uint8_t( std::max( 32.f, std::min( 240.f, dim ) ) );
     }
+    stride = size_t( dimension ) + 1;
+    const size_t nBins = BinCount();
+
+    assert( nBins <= 0x10000 ); // for bintri_type
+
+    // verts and center of each tri, and their bins
+    std::vector<std::array<glm::vec3, 4>>& triVecs = resetVecs;
+    triVecs.resize( indTri.size() );
+    triBins.resize( indTri.size() );
+    triSerials.assign( indTri.size(), 0 );
+    inflatedTris.Resize( indTri.size() );
+    inflatedBins.Resize( nBins );
+
+    // a (bin, tri) pair for each bin a tri is filed in, with which of its points are filed there.
+    // chunks count theirs, then write them in tri order so the stable sort leaves each bin's tris ascending
+    auto fnPoints = [] (const tribins_type& tb, int i) -> uint8_t {
+        for(int j = 0; j < i; j++) if( tb[j] == tb[i] ) return 0; // listed with an earlier point
+        uint8_t points = 0;
+        for(int j = i; j < 4; j++) if( tb[j] == tb[i] ) points |= uint8_t( 1 << j );
+        return points;
+    };
+
+    const size_t grain = 4096;
+    std::vector<size_t> chunkPairs( AppJobs::Chunks( 0, indTri.size(), grain ) + 1, 0 );
+    jobs.ParallelFor( 0, indTri.size(), grain, [&] (size_t first, size_t end) {
+        size_t pairs = 0;
+        for(size_t triID = first; triID < end; triID++)
+        {
+            TriBins( triVecs[ triID ].data(), triBins[ triID ], triID_type( triID ) ); // ask only for triangles from the renderable
+            for(int i = 0; i < 4; i++) if( fnPoints( triBins[ triID ], i ) ) pairs++;
+        }
+        chunkPairs[ first / grain + 1 ] = pairs;
+    } );
+    std::partial_sum( chunkPairs.begin(), chunkPairs.end(), chunkPairs.begin() );
+
+    std::vector<bintri_type>& binTris = resetPairs;
+    binTris.resize( chunkPairs.back() );
+    jobs.ParallelFor( 0, indTri.size(), grain, [&] (size_t first, size_t end) {
+        size_t next = chunkPairs[ first / grain ];
+        for(size_t triID = first; triID < end; triID++)
+            for(int i = 0; i < 4; i++)
+                if( uint8_t points = fnPoints( triBins[ triID ], i ) )
+                    binTris[ next++ ] = { triID_type( triID ), uint16_t( BinIndex( triBins[ triID ][i] ) ), points };
+    } );
+
+    unsigned binBits = 1;
+    while( ( nBins - 1 ) >> binBits ) binBits++;
+    jobs.ParallelRadixSort( binTris, [] (const bintri_type& bt) { return bt.bin; }, binBits, 16384, &resetSorted );
+
+    // where each bin's pairs start, set at each change of bin for it and the empty bins before it
+    std::vector<size_t>& binPairs = resetBinPairs;
+    binPairs.resize( nBins + 1 );
+    jobs.ParallelFor( 0, binTris.size() + 1, 16384, [&] (size_t first, size_t end) {
+        for(size_t p = first; p < end; p++)
+        {
+            const size_t before = p == 0 ? 0 : size_t( binTris[ p - 1 ].bin ) + 1;
+            const size_t at = p == binTris.size() ? nBins : binTris[ p ].bin;
+            for(size_t b = before; b <= at; b++) binPairs[ b ] = p;
+        }
+    } );
 
-    for( auto iter = uniqueBinTris.begin(); iter != uniqueBinTris.end(); ++iter )
+    // rows, with room for a stroke to inflate into
+    binRows.assign( nBins, binrow_type() );
+    binSlots = 0;
+    uint32_t maxCapacity = 0;
+    for(size_t b = 0; b < nBins; b++)
     {
-        binTris.insert(std::make_pair(iter->id.bin, triID_markable( iter->id.tri ) ));
+        binrow_type& row = binRows[ b ];
+        row.first = binSlots;
+        row.count = uint32_t( binPairs[ b + 1 ] - binPairs[ b ] );
+        row.capacity = row.count + ( row.count >> 1 );
+        binSlots += row.capacity;
+        maxCapacity = std::max( maxCapacity, row.capacity );
     }
+    encloseVecs.reserve( 4 * maxCapacity ); // a full row's verts and centers, for RowEnclose()
+
+    binTriIDs.assign( binSlots, TriIDEnd );
+    binTriIDs.reserve( 2 * binSlots ); // rows that outgrow their slots move into this until Refit() packs
+    rowTris.Resize( binTriIDs.capacity() );
+    staleRows.Resize( nBins );
+    rowBounds.assign( nBins, glm::vec4( 0.f ) );
+    blockBounds.assign( BlockCount(), glm::vec4( 0.f ) );
+    staleBlocks.Resize( blockBounds.size() );
+
+    // then each bin's members, sphere and row for the ray kernel
+    binSpheres.assign( nBins, sph_markable() );
+    jobs.ParallelFor( 0, nBins, 256, [&] (size_t first, size_t end) {
+        std::vector<glm::vec3> vecs;
+        for(size_t b = first; b < end; b++)
+        {
+            const binrow_type& row = binRows[ b ];
+            vecs.clear();
+            for(size_t p = binPairs[ b ]; p < binPairs[ b + 1 ]; p++)
+            {
+                const bintri_type& bt = binTris[ p ];
+                binTriIDs[ row.first + ( p - binPairs[ b ] ) ] = bt.tri;
+                for(int i = 0; i < 4; i++) if( ( bt.points >> i ) & 1 ) vecs.push_back( triVecs[ bt.tri ][i] );
+            }
+            Enclose( binSpheres[ b ], vecs );
+            RowRead( b, triVecs.data() );
+        }
+    } );
+    staleBlocks.SetAll();
 
-#ifdef DEBUG
-    printf("rubus %zu spheres\n", binSpheres.size());
-    printf("rubus %zu uniqueBinTris\n", uniqueBinTris.size());
-#endif // DEBUG
+    AppLog::Info(__FILENAME__, "rubus %s dimension %u\n", binning == CubeBinning ? "cube" : "lat/long", uint( dimension ));
+    AppLog::Info(__FILENAME__, "rubus %lu bintris, %s ray kernel\n", binSlots, CRayTris::KernelName());
 }
 
-void CRubus::Release()
+template<class Mesh>
+void CRubus<Mesh>::TriBins(glm::vec3 vecs_out[4], tribins_type& bins_out, triID_type triID)
 {
-    binSpheres.clear();
-    binTris.clear();
-    pTriagonalnomial = 0;
+    pTriagonalnomial->GetTriVerts(vecs_out[0], vecs_out[1], vecs_out[2], triID);
+    vecs_out[3] = (vecs_out[0] + vecs_out[1] + vecs_out[2]) * glm::vec3( 1.f / 3.f );
+    for(int i = 0; i < 4; i++) bins_out[i] = BinMake( vecs_out[i] );
 }
 
-void CRubus::Reset()
+// rebuilds only the bins the moved tris were, are, or were inflated into. those bins get the
+// same members and spheres a Reset() would give them, and the other bins are already right
+template<class Mesh>
+void CRubus<Mesh>::Refit(const dirtybits_type& movedTris)
 {
-    binSpheres.clear();
-    binTris.clear();
-
-    /////////
-
-    std::multimap<binID_type, glm::vec3> binVecs; // use copies here to incl center tri point
-    std::set<binID_type> binNames;
-    std::set<bintri_type> uniqueBinTris;
-    std::list<glm::vec3> centerPoints;
+    movedTris.ForEach( [&] (size_t t) { inflatedTris.Set( t ); } );
+    if( !inflatedTris.Any() ) return;
+    const dirtybits_type& refitTris = inflatedTris;
+    dirtybits_type& refitBins = inflatedBins;
+
+    // refiled tris by bin
+    std::vector<std::pair<size_t, triID_type>> filings;
+    glm::vec3 vecs[4];
+    refitTris.ForEach( [&] (size_t t) {
+        tribins_type& tb = triBins[ t ];
+        for(int i = 0; i < 4; i++) refitBins.Set( BinIndex( tb[i] ) );
+        TriBins( vecs, tb, triID_type( t ) );
+        for(int i = 0; i < 4; i++)
+        {
+            refitBins.Set( BinIndex( tb[i] ) );
+            if( std::find( tb.begin(), tb.begin() + i, tb[i] ) == tb.begin() + i )
+                filings.push_back( std::make_pair( BinIndex( tb[i] ), triID_type( t ) ) );
+        }
+    } );
+    std::sort( filings.begin(), filings.end() );
+
+    std::vector<triID_type> members;
+    std::vector<glm::vec3> binVecs;
+    auto iterFiling = filings.begin();
+    refitBins.ForEach( [&] (size_t b) {
+        // the members that stayed put, and the refiled tris that landed here
+        const binrow_type& row = binRows[ b ];
+        members.clear();
+        for(uint32_t k = 0; k < row.count; k++)
+            if( !refitTris.Test( binTriIDs[ row.first + k ] ) ) members.push_back( binTriIDs[ row.first + k ] );
+        while( iterFiling != filings.end() && iterFiling->first < b ) ++iterFiling;
+        for( ; iterFiling != filings.end() && iterFiling->first == b; ++iterFiling ) members.push_back( iterFiling->second );
+        std::sort( members.begin(), members.end() );
+        RowAssign( b, members );
+
+        // in tri order, as Reset() adds them
+        const binID_type bin = BinOf( b );
+        binVecs.clear();
+        for( auto t : members )
+        {
+            tribins_type tb;
+            TriBins( vecs, tb, t );
+            for(int i = 0; i < 4; i++) if( tb[i] == bin ) binVecs.push_back( vecs[i] );
+        }
+        Enclose( binSpheres[ b ], binVecs );
+    } );
 
-    std::vector<ind3_type>& indTri = pTriagonalnomial->GetIndTris();
+    refitBins.Clear();
+    inflatedTris.Clear();
+    if( binTriIDs.size() > 2 * binSlots ) Pack();
+}
 
-    glm::vec3 v0, v1, v2;
+// calc center then determine radius
+template<class Mesh>
+void CRubus<Mesh>::Enclose(sph_markable& sph_out, const std::vector<glm::vec3>& vecs)
+{
+    sph_out.radius = 0.f;
+    sph_out.center = glm::vec3(0);
+    sph_out.serial = 0;
 
-    // ask only for triangles from the renderable
-    for(triID_type triID = 0; triID < indTri.size(); triID++)
+    for( size_t i = 0; i < vecs.size(); i++ )
     {
-        pTriagonalnomial->GetTriVerts(v0, v1, v2, triID);
+        if( i == 0 )
+            sph_out.center = vecs[i];
+        else
+            sph_out.center = ( vecs[i] + sph_out.center ) / 2.f;
+    }
 
-        centerPoints.push_front( (v0 + v1 + v2) * glm::vec3( 1.f / 3.f ) );
-        glm::vec3 & center = centerPoints.front();
+    for( size_t i = 0; i < vecs.size(); i++ )
+    {
+        if( i == 0 )
+        {
+            // default radius is half the partition length of an n-partitioned circle-circumference
+            sph_out.radius = 2.f * (float)M_PI * glLength(vecs[i]) / BinsAround() / 2.f;
 
-        binID_type b0 = BinMake( v0, dimension);
-        binID_type b1 = BinMake( v1, dimension);
-        binID_type b2 = BinMake( v2, dimension);
-        binID_type bc = BinMake( center, dimension);
+            // todo: incr in size should be dep on tri size?
+            sph_out.radius *= 2.f; // hack doubles size to assist overlap
+        }
+        else
+        {
+            sph_out.radius = std::max( sph_out.radius, glLength(vecs[i] - sph_out.center) );
+        }
+    }
+}
 
-        binVecs.insert( std::make_pair(b0, v0) );
-        binVecs.insert( std::make_pair(b1, v1) );
-        binVecs.insert( std::make_pair(b2, v2) );
-        binVecs.insert( std::make_pair(bc, center) );
+template<class Mesh>
+void CRubus<Mesh>::RowMove(size_t index, uint32_t capacity)
+{
+    binrow_type& row = binRows[ index ];
+    const size_t first = binTriIDs.size();
+    binTriIDs.resize( first + capacity, TriIDEnd );
+    std::copy( binTriIDs.begin() + row.first, binTriIDs.begin() + row.first + row.count, binTriIDs.begin() + first );
+    binSlots = binSlots + capacity - row.capacity;
+    row.first = first;
+    row.capacity = capacity;
+    staleRows.Set( index );
+    encloseVecs.reserve( 4 * capacity );
+}
 
-        binNames.insert( b0 );
-        binNames.insert( b1 );
-        binNames.insert( b2 );
-        binNames.insert( bc );
+template<class Mesh>
+void CRubus<Mesh>::RowAssign(size_t index, const std::vector<triID_type>& tris)
+{
+    if( tris.size() > binRows[ index ].capacity ) RowMove( index, uint32_t( tris.size() + ( tris.size() >> 1 ) ) );
+    binrow_type& row = binRows[ index ];
+    std::copy( tris.begin(), tris.end(), binTriIDs.begin() + row.first );
+    row.count = uint32_t( tris.size() );
+    staleRows.Set( index );
+}
 
-        uniqueBinTris.insert( bintri_type(b0, triID) );
-        uniqueBinTris.insert( bintri_type(b1, triID) );
-        uniqueBinTris.insert( bintri_type(b2, triID) );
-        uniqueBinTris.insert( bintri_type(bc, triID) );
+template<class Mesh>
+void CRubus<Mesh>::RowInsert(size_t index, triID_type triID)
+{
+    {
+        const binrow_type& row = binRows[ index ];
+        auto begin = binTriIDs.begin() + row.first, end = begin + row.count;
+        if( std::find( begin, end, triID ) != end ) return;
+        if( row.count == row.capacity ) RowMove( index, std::max<uint32_t>( 4, row.capacity * 2 ) );
     }
+    binrow_type& row = binRows[ index ];
+    binTriIDs[ row.first + row.count++ ] = triID;
+    staleRows.Set( index );
+}
 
-    // for each bin, calc center then determine radius
-    for( auto iterBin = binNames.begin(); iterBin != binNames.end(); ++iterBin )
-    {
-        sph_markable sph;
-        sph.radius = 0.f;
-        sph.center = glm::vec3(0);
-        sph.serial = 0;
+template<class Mesh>
+void CRubus<Mesh>::RowRemove(size_t index, triID_type triID)
+{
+    binrow_type& row = binRows[ index ];
+    auto begin = binTriIDs.begin() + row.first, end = begin + row.count;
+    if( std::remove( begin, end, triID ) != end ) binTriIDs[ row.first + --row.count ] = TriIDEnd;
+    staleRows.Set( index );
+}
 
-        Inflate(sph, *iterBin, binVecs);
+template<class Mesh>
+void CRubus<Mesh>::RowCache(size_t index)
+{
+    if( !staleRows.Test( index ) ) return;
+    staleRows.Clear( index );
 
-        binSpheres.insert(std::make_pair(*iterBin,sph));
-    }
+    if( rowTris.Slots() < binTriIDs.size() ) rowTris.Resize( binTriIDs.capacity() );
+    RowRead( index );
+    staleBlocks.Set( BlockOf( index ) );
+}
 
-    for( auto iter = uniqueBinTris.begin(); iter != uniqueBinTris.end(); ++iter )
+// reads the row's tris from the model, and bounds them
+template<class Mesh>
+void CRubus<Mesh>::RowRead(size_t index, const std::array<glm::vec3, 4>* triVecs)
+{
+    const binrow_type& row = binRows[ index ];
+    glm::vec3 lo( std::numeric_limits<float>::max() ), hi( -std::numeric_limits<float>::max() );
+    for(uint32_t k = 0; k < row.count; k++)
     {
-        binTris.insert(std::make_pair( iter->id.bin, triID_markable(iter->id.tri ) ));
+        const triID_type triID = binTriIDs[ row.first + k ];
+        glm::vec3 v0, v1, v2;
+        if( triVecs ) { v0 = triVecs[ triID ][0]; v1 = triVecs[ triID ][1]; v2 = triVecs[ triID ][2]; }
+        else pTriagonalnomial->GetTriVerts(v0, v1, v2, triID);
+        rowTris.Set( row.first + k, v0, v1, v2 );
+        lo = glm::min( lo, glm::min( v0, glm::min( v1, v2 ) ) );
+        hi = glm::max( hi, glm::max( v0, glm::max( v1, v2 ) ) );
     }
 
-    AppLog::Info(__FILENAME__, "rubus %lu spheres\n", binSpheres.size());
-    AppLog::Info(__FILENAME__, "rubus %lu uniqueBinTris\n", uniqueBinTris.size());
+    // around the whole of each tri, not just the points filed here. and some for rounding
+    if( row.count == 0 ) rowBounds[ index ] = glm::vec4( 0.f );
+    else rowBounds[ index ] = glm::vec4( ( lo + hi ) * .5f, glm::length( hi - lo ) * .5f * 1.0001f );
 }
 
-// todo: 13jul profiled at 53/.7/40k
-void CRubus::Inflate(sph_markable& sph, binID_type bin, std::multimap<binID_type, glm::vec3> const & binVecs)
+// a sphere around the bounds of a block of rows, so IdentifyTris() can pass over the block at once
+template<class Mesh>
+void CRubus<Mesh>::BlockBounds(size_t block)
 {
-    using const_BinVecIter = std::multimap<binID_type, glm::vec3>::const_iterator;
+    glm::vec3 lo( std::numeric_limits<float>::max() ), hi( -std::numeric_limits<float>::max() );
+    ForBlockRows( block, [&] (size_t b) {
+        if( binRows[ b ].count == 0 ) return;
+        lo = glm::min( lo, glm::vec3( rowBounds[ b ] ) - rowBounds[ b ].w );
+        hi = glm::max( hi, glm::vec3( rowBounds[ b ] ) + rowBounds[ b ].w );
+    } );
+    if( lo.x > hi.x ) { blockBounds[ block ] = glm::vec4( 0.f ); return; } // empty rows are skipped anyway
+
+    const glm::vec3 center = ( lo + hi ) * .5f;
+    float radius = 0.f;
+    ForBlockRows( block, [&] (size_t b) {
+        if( binRows[ b ].count > 0 ) radius = std::max( radius, glm::distance( center, glm::vec3( rowBounds[ b ] ) ) + rowBounds[ b ].w );
+    } );
+    blockBounds[ block ] = glm::vec4( center, radius * 1.0001f );
+}
 
-    for( const_BinVecIter iterVec = binVecs.lower_bound(bin); iterVec != binVecs.upper_bound(bin); ++iterVec )
+// fits the sphere to the row's vecs that are filed in this bin, where they are now
+template<class Mesh>
+void CRubus<Mesh>::RowEnclose(size_t index)
+{
+    const binrow_type& row = binRows[ index ];
+    const binID_type bin = BinOf( index );
+    encloseVecs.clear();
+    for(uint32_t k = 0; k < row.count; k++)
     {
-        if( iterVec == binVecs.lower_bound(bin) )
-            sph.center = iterVec->second;
-        else
-            sph.center = ( iterVec->second + sph.center ) / 2.f;
+        const triID_type t = binTriIDs[ row.first + k ];
+        glm::vec3 vecs[4];
+        pTriagonalnomial->GetTriVerts(vecs[0], vecs[1], vecs[2], t);
+        vecs[3] = (vecs[0] + vecs[1] + vecs[2]) * glm::vec3( 1.f / 3.f );
+        for(int i = 0; i < 4; i++) if( triBins[ t ][i] == bin ) encloseVecs.push_back( vecs[i] );
     }
+    Enclose( binSpheres[ index ], encloseVecs );
+}
 
-    for( const_BinVecIter iterVec = binVecs.lower_bound(bin); iterVec != binVecs.upper_bound(bin); ++iterVec )
+// closes up the holes left by moved rows
+template<class Mesh>
+void CRubus<Mesh>::Pack()
+{
+    std::vector<triID_type> packed( binSlots, TriIDEnd );
+    size_t first = 0;
+    for( auto& row : binRows )
     {
-        if( iterVec == binVecs.lower_bound(bin) )
-        {
-            // default radius is half the partition length of an n-partitioned circle-circumference
-            sph.radius = 2.f * (float)M_PI * glLength(iterVec->second) / dimension / 2.f;
-
-            // todo: incr in size should be dep on tri size?
-            sph.radius *= 2.f; // hack doubles size to assist overlap
-        }
-        else
-        {
-            sph.radius = std::max( sph.radius, glLength(iterVec->second - sph.center) );
-        }
+        std::copy( binTriIDs.begin() + row.first, binTriIDs.begin() + row.first + row.count, packed.begin() + first );
+        row.first = first;
+        first += row.capacity;
     }
+    binTriIDs.swap( packed );
+    binTriIDs.reserve( 2 * binSlots );
+    staleRows.SetAll();
 }
 
 // todo: 13jul profiled at 21/.8/86
-void CRubus::Inflate(triID_type triID, const glm::vec3& v0, const glm::vec3 & v1, const glm::vec3& v2)
+template<class Mesh>
+void CRubus<Mesh>::Inflate(triID_type triID, const glm::vec3& v0, const glm::vec3 & v1, const glm::vec3& v2)
 {
-    std::list<glm::vec3> centerPoints;
-    centerPoints.push_front( (v0 + v1 + v2) * glm::vec3( 1.f / 3.f ) );
-    glm::vec3 & center = centerPoints.front();
-
-    binID_type b0 = BinMake( v0, dimension);
-    binID_type b1 = BinMake( v1, dimension);
-    binID_type b2 = BinMake( v2, dimension);
-    binID_type bc = BinMake( center, dimension);
-
-    std::multimap<binID_type, glm::vec3> binVecs; // use copies here to incl center tri point
-    binVecs.insert( std::make_pair(b0, v0) );
-    binVecs.insert( std::make_pair(b1, v1) );
-    binVecs.insert( std::make_pair(b2, v2) );
-    binVecs.insert( std::make_pair(bc, center) );
-
-    std::set<binID_type> binNames;
-    binNames.insert( b0 );
-    binNames.insert( b1 );
-    binNames.insert( b2 );
-    binNames.insert( bc );
-
-    // todo: clean old tri from bin? difficult, easier to flush on reset...
-
-    // for each of the vertex-bins...
-    using const_BinNameIter = std::set<binID_type>::const_iterator;
-    for( const_BinNameIter iterBin = binNames.begin(); iterBin != binNames.end(); ++iterBin )
+    const glm::vec3 vecs[4] = { v0, v1, v2, (v0 + v1 + v2) * glm::vec3( 1.f / 3.f ) };
+    tribins_type tb;
+    for(int i = 0; i < 4; i++) tb[i] = BinMake( vecs[i] );
+
+    auto fnFirst = [] (const tribins_type& bins, int i) { return std::find( bins.begin(), bins.begin() + i, bins[i] ) == bins.begin() + i; };
+    auto fnHas = [] (const tribins_type& bins, binID_type bin) { return std::find( bins.begin(), bins.end(), bin ) != bins.end(); };
+
+    // leave the bins it has moved out of
+    tribins_type& filed = triBins[ triID ];
+    const tribins_type was = filed;
+    filed = tb;
+    for(int i = 0; i < 4; i++)
     {
-        // get the bin-sphere...
-        auto iterSph = binSpheres.find(*iterBin); // todo: log time complexity
-        if( iterSph == binSpheres.end() )
-        {
-            sph_markable sph;
-            sph.radius = 0.f;
-            sph.center.x = sph.center.y = sph.center.z = 0.f;
-            sph.serial = 0;
-            auto rv = binSpheres.insert( std::make_pair( *iterBin , sph ) );
-            iterSph = rv.first;
-        }
-
-        // adjust the sphere so it holds all the verticies in it
-        Inflate(iterSph->second, *iterBin, binVecs); // todo: check shrinking sphere should not exclude verts that are in the bin!
-
-        binSpheres.insert( std::make_pair( *iterBin, iterSph->second ) ); // todo: review. retained? appears not.
+        if( !fnFirst( was, i ) || fnHas( tb, was[i] ) ) continue;
+        const size_t b = BinIndex( was[i] );
+        RowRemove( b, triID );
+        RowEnclose( b );
+        inflatedBins.Set( b );
     }
 
-    // fold the bins relevant to the specified triangle into a set to reduce duplicates
-    std::set<bintri_type> uniqueBinTris;
-    uniqueBinTris.insert( bintri_type(b0, triID) );
-    uniqueBinTris.insert( bintri_type(b1, triID) );
-    uniqueBinTris.insert( bintri_type(b2, triID) );
-    uniqueBinTris.insert( bintri_type(bc, triID) );
-
-    // iterate through set of unique bins...
-    using const_BinTriIter = std::set<bintri_type>::const_iterator;
-    for( const_BinTriIter setIter = uniqueBinTris.begin(); setIter != uniqueBinTris.end(); ++setIter )
+    // join the ones it's moved into, growing the spheres of all it's in to hold its vecs
+    for(int i = 0; i < 4; i++)
     {
-        // ... for each of the triangle's bins, search through the bin multimap to ensure the triangle exists there
-        bool foundInBin = false;
-        for( auto binIter = binTris.lower_bound(setIter->id.bin); binIter != binTris.upper_bound(setIter->id.bin); ++binIter )
+        if( !fnFirst( tb, i ) ) continue;
+        const size_t b = BinIndex( tb[i] );
+        sph_markable& sph = binSpheres[ b ];
+        if( !fnHas( was, tb[i] ) ) RowInsert( b, triID );
+        if( binRows[ b ].count == 1 )
         {
-            if( binIter->second.triID == triID )
-            {
-                foundInBin = true;
-                break;
-            }
+            RowEnclose( b );
         }
-
-        if(!foundInBin)
-            binTris.insert( std::make_pair( setIter->id.bin, triID_markable( triID ) ) ); // retained. must be flushed on reset.
+        else
+        {
+            for(int k = i; k < 4; k++) if( tb[k] == tb[i] ) sph.radius = std::max( sph.radius, glLength(vecs[k] - sph.center) );
+        }
+        inflatedBins.Set( b );
     }
+    inflatedTris.Set( triID );
 }
 
-void CRubus::IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm::vec3 const &direction)
+template<class Mesh>
+void CRubus<Mesh>::IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm::vec3 const &direction)
 {
     char stat;
     uint tris = 0, sphs = 0, sphsc = 0;
 
-    serial++;
+    if( ++serial == 0 )
+    {
+        // wrapped, so clear the old marks before they can match
+        for( auto& sph : binSpheres ) sph.serial = 0;
+        std::fill( triSerials.begin(), triSerials.end(), 0 );
+        serial = 1;
+    }
 
-    auto fnCheckTri = [&] (triID_markable markableTri) -> bool
+    auto fnCheckTri = [&] (triID_type triID) -> bool
     {
-        if( markableTri.triID == TriIDEnd ) return false;
-        if( markableTri.serial == serial ) return false;
-        markableTri.serial = serial;
+        if( triID >= triSerials.size() ) return false; // includes TriIDEnd
+        if( triSerials[ triID ] == serial ) return false;
+        triSerials[ triID ] = serial;
         tris++;
 
         glm::vec3 v0, v1, v2;
-        pTriagonalnomial->GetTriVerts(v0, v1, v2, markableTri.triID);
+        pTriagonalnomial->GetTriVerts(v0, v1, v2, triID);
 
         // requires glm-0.9.7.6
         glm::vec3 triangleBarycentricCoord;
@@ -319,64 +509,68 @@ void CRubus::IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm
                 position, direction, v0, v1, v2, triangleBarycentricCoord
         ) ) return false;
 
-        cxt_out.collisionTri = markableTri.triID;
+        cxt_out.collisionTri = triID;
+        cxt_out.collisionBary = glm::vec2( triangleBarycentricCoord );
+        cxt_out.collisionDist = triangleBarycentricCoord.z;
+        return true;
+    };
+
+    // check the tris in this bin, the first hit as they're listed
+    auto fnCheckRow = [&] (size_t b) -> bool
+    {
+        RowCache( b );
+        const binrow_type& row = binRows[ b ];
+        tris += row.count;
+
+        glm::vec3 bary;
+        const uint32_t k = rowTris.FirstHit( row.first, row.count, position, direction, bary );
+        if( k == CRayTris::NoHit ) return false;
+
+        cxt_out.collisionTri = binTriIDs[ row.first + k ];
+        cxt_out.collisionBary = glm::vec2( bary );
+        cxt_out.collisionDist = bary.z;
+        cxt_out.collisionBin = BinOf( b );
         return true;
     };
 
     auto fnCheckBin = [&] (binID_type bin) -> bool
     {
         // mark bin/sphere
-        auto iterSph = binSpheres.find(bin);
-        if( iterSph == binSpheres.end() ) return false;
-        if( iterSph->second.serial == serial ) return false;
-        iterSph->second.serial = serial;
+        if( !BinValid( bin ) ) return false;
+        const size_t b = BinIndex( bin );
+        if( binRows[ b ].count == 0 ) return false;
+        sph_markable& sph = binSpheres[ b ];
+        if( sph.serial == serial ) return false;
+        sph.serial = serial;
         sphs++;
 
-        // check the tris in this bin
-        for( auto iter = binTris.lower_bound(bin); iter != binTris.upper_bound(bin); ++iter )
-        {
-            if( fnCheckTri( iter->second ) )
-            {
-                cxt_out.collisionBin = bin;
-                return true;
-            }
-        }
-        return false;
+        return fnCheckRow( b );
     };
 
-    auto fnCheckSph = [&] (binID_type bin) -> bool
+    auto fnCheckSph = [&] (size_t b) -> bool
     {
         // mark bin/sphere
-        auto iterSph = binSpheres.find(bin);
-        if( iterSph == binSpheres.end() ) return false;
-        if( iterSph->second.serial == serial ) return false;
-        iterSph->second.serial = serial;
+        if( binRows[ b ].count == 0 ) return false;
+        sph_markable& sph = binSpheres[ b ];
+        if( sph.serial == serial ) return false;
+        sph.serial = serial;
         sphs++;
 
-        if( iterSph->second.radius <= std::numeric_limits<float>::epsilon() ) return false;
+        if( sph.radius <= std::numeric_limits<float>::epsilon() ) return false;
 
         // skip non-relevant spheres
         // if the ray intersects the sphere, check the specified bin to see which triangle the ray hits
         float circleIntersectionDistance;
         if( !glm::intersectRaySphere<glm::vec3>(
-                position, direction, iterSph->second.center, iterSph->second.radius * iterSph->second.radius, circleIntersectionDistance
+                position, direction, sph.center, sph.radius * sph.radius, circleIntersectionDistance
         ) ) return false;
         sphsc++; // how many in collision with?
 
-        // check the tris in this bin
-        for( auto iter = binTris.lower_bound(bin); iter != binTris.upper_bound(bin); ++iter )
-        {
-            if( fnCheckTri( iter->second ) )
-            {
-                cxt_out.collisionBin = bin;
-                return true;
-            }
-        }
-        return false;
+        return fnCheckRow( b );
     };
 
     stat = 'A';
-    if( cxt_out.collisionTri != TriIDEnd && fnCheckTri( triID_markable( cxt_out.collisionTri ) ) ) goto hit; // nb: suboptimal stack object
+    if( cxt_out.collisionTri != TriIDEnd && fnCheckTri( cxt_out.collisionTri ) ) goto hit;
     cxt_out.collisionTri = TriIDEnd;
 
     stat = 'B';
@@ -389,50 +583,48 @@ void CRubus::IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm
 
     // check nearby bins
     stat = 'D';
-    for(int8_t d=1;d<dimension/4;d++)
+    for(int d=1;d<int( BinReach() );d++)
     {
         // major axis sides
-        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, 0, dimension ) ) ) goto hit;
-        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, 0, dimension ) ) ) goto hit;
-        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, 0, -d, dimension ) ) ) goto hit;
-        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, 0, +d, dimension ) ) ) goto hit;
+        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, 0 ) ) ) goto hit;
+        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, 0 ) ) ) goto hit;
+        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, 0, -d ) ) ) goto hit;
+        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, 0, +d ) ) ) goto hit;
 
         // corners
-        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, -d, dimension ) ) ) goto hit;
-        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, -d, dimension ) ) ) goto hit;
-        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, +d, dimension ) ) ) goto hit;
-        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, +d, dimension ) ) ) goto hit;
+        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, -d ) ) ) goto hit;
+        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, -d ) ) ) goto hit;
+        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, +d ) ) ) goto hit;
+        if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, +d ) ) ) goto hit;
 
         // others
-        for(int8_t e=1;e<(d-1);e++)
+        for(int e=1;e<(d-1);e++)
         {
             // horizontals
-            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +e, -d, dimension ) ) ) goto hit;
-            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -e, -d, dimension ) ) ) goto hit;
-            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +e, +d, dimension ) ) ) goto hit;
-            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -e, +d, dimension ) ) ) goto hit;
+            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +e, -d ) ) ) goto hit;
+            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -e, -d ) ) ) goto hit;
+            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +e, +d ) ) ) goto hit;
+            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -e, +d ) ) ) goto hit;
             // verticals
-            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, +e, dimension ) ) ) goto hit;
-            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, -e, dimension ) ) ) goto hit;
-            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, +e, dimension ) ) ) goto hit;
-            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, -e, dimension ) ) ) goto hit;
+            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, +e ) ) ) goto hit;
+            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, -d, -e ) ) ) goto hit;
+            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, +e ) ) ) goto hit;
+            if( fnCheckBin( BinAdjust( cxt_out.lastValidBin, +d, -e ) ) ) goto hit;
         }
     }
 
     // sweep the remaining bins
     stat = 'E';
-    for(auto iter : binSpheres)
+    for( size_t b = 0; b < binRows.size(); b++ )
     {
-        if( fnCheckSph( iter.first ) ) goto hit;
+        if( fnCheckSph( b ) ) goto hit;
     }
 
     // and remaining tris for a bin!
     stat = 'Z';
-    for( auto iter : binTris )
+    for( size_t b = 0; b < binRows.size(); b++ )
     {
-        if( !fnCheckTri( iter.second ) ) continue;
-        cxt_out.collisionBin = iter.first;
-        goto hit;
+        if( fnCheckRow( b ) ) goto hit;
     }
 
     stat = '?';
@@ -446,3 +638,104 @@ void CRubus::IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position, glm
     AppLog::Info(__FILENAME__, "IdentifyTri collisionTri %d", cxt_out.collisionTri);
 #endif // CHATTY
 }
+
+// the nearest hits for a packet of rays. their hits in the bin they start from bound how far the rest
+// of the search looks, and the only rows that can hold a nearer hit are those whose bounds are both
+// inside the packet's cone and nearer than its farthest hit so far
+template<class Mesh>
+void CRubus<Mesh>::IdentifyTris(trisearch_type* cxts_out, const trisearch_type& cxt, glm::vec3 const &position, const glm::vec3* directions, uint n)
+{
+    if( n == 0 ) return;
+
+    packetSlots.assign( n, CRayTris::NoHit );
+    packetBarys.assign( n, glm::vec3( 0.f, 0.f, std::numeric_limits<float>::max() ) );
+    packetBins.assign( n, BinIDEnd );
+    float farthest = std::numeric_limits<float>::max();
+
+    auto fnCheckRow = [&] (size_t b)
+    {
+        const binrow_type& row = binRows[ b ];
+        if( !rowTris.NearestHits( row.first, row.count, position, directions, n, packetSlots.data(), packetBarys.data() ) ) return;
+
+        farthest = 0.f;
+        for( uint r = 0; r < n; r++ )
+        {
+            if( packetSlots[ r ] != CRayTris::NoHit && packetSlots[ r ] - row.first < row.count ) packetBins[ r ] = BinOf( b );
+            farthest = std::max( farthest, packetBarys[ r ].z );
+        }
+    };
+
+    staleRows.ForEach( [&] (size_t b) { RowCache( b ); } );
+
+    const binID_type seedBin = cxt.collisionBin != BinIDEnd ? cxt.collisionBin : cxt.lastValidBin;
+    const size_t seed = BinValid( seedBin ) ? BinIndex( seedBin ) : binRows.size();
+    if( seed < binRows.size() ) fnCheckRow( seed );
+
+    // the cone around the rays, when it's narrow enough to cull with
+    glm::vec3 axis( 0.f );
+    for( uint r = 0; r < n; r++ ) axis += directions[ r ];
+    axis = glm::normalize( axis );
+    float cosCone = 1.f;
+    for( uint r = 0; r < n; r++ ) cosCone = std::min( cosCone, glm::dot( axis, directions[ r ] ) );
+    const bool narrow = cosCone > 0.f; // nb: fails on nan
+    const float sinCone = narrow ? std::sqrt( 1.f - cosCone * cosCone ) : 0.f;
+
+    // outside when past the farthest hit, or when farther from the cone's side than the radius,
+    // ie when across * cosCone - along * sinCone > radius
+    auto fnOutside = [&] (const glm::vec4& bounds, float& dist2_out) -> bool
+    {
+        const glm::vec3 v = glm::vec3( bounds ) - position;
+        dist2_out = glm::dot( v, v );
+        const float reach = farthest + bounds.w;
+        if( dist2_out > reach * reach ) return true;
+        if( !narrow ) return false;
+
+        const float along = glm::dot( v, axis );
+        const float side = bounds.w + along * sinCone;
+        return side < 0.f || ( dist2_out - along * along ) * cosCone * cosCone > side * side;
+    };
+
+    staleBlocks.ForEach( [&] (size_t k) { BlockBounds( k ); } );
+    staleBlocks.Clear();
+
+    // the rows that can hold a nearer hit, by how near they start
+    packetRows.clear();
+    for( size_t k = 0; k < blockBounds.size(); k++ )
+    {
+        float dist2;
+        if( fnOutside( blockBounds[ k ], dist2 ) ) continue;
+
+        ForBlockRows( k, [&] (size_t b) {
+            if( b == seed || binRows[ b ].count == 0 ) return;
+            if( fnOutside( rowBounds[ b ], dist2 ) ) return;
+            packetRows.push_back( std::make_pair( std::sqrt( dist2 ) - rowBounds[ b ].w, b ) );
+        } );
+    }
+    std::sort( packetRows.begin(), packetRows.end() );
+
+    for( auto& row : packetRows )
+    {
+        if( row.first > farthest ) break;
+        fnCheckRow( row.second );
+    }
+
+    for( uint r = 0; r < n; r++ )
+    {
+        trisearch_type& cxt_out = cxts_out[ r ];
+        cxt_out = cxt;
+        cxt_out.collisionBin = packetBins[ r ];
+        if( packetSlots[ r ] == CRayTris::NoHit )
+        {
+            cxt_out.collisionTri = TriIDEnd;
+            continue;
+        }
+
+        cxt_out.collisionTri = binTriIDs[ packetSlots[ r ] ];
+        cxt_out.collisionBary = glm::vec2( packetBarys[ r ] );
+        cxt_out.collisionDist = packetBarys[ r ].z;
+        cxt_out.lastValidBin = cxt_out.collisionBin;
+    }
+}
+
+template struct CRubus<RSphere>;
+template struct CRubus<IDefineTri>;
@@ -5,7 +5,7 @@
 
 #include <unistd.h>
 #include <vector>
-#include <map>
+#include <array>
 #include <functional>
 
 #include <glm/glm.hpp>
@@ -13,8 +13,13 @@
 #include <deque>
 
 #include "AppTypes.hpp"
+#include "TriTools.hpp"
+#include "CRayTris.hpp"
 
 // The Rubus is the Genera of the Blackberry...
+// Mesh is the model's own type, so its tri accessors are inlined into the bin loops, or IDefineTri
+// to reach a model through its virtuals. CRubus.cpp instantiates those it is built for
+template<class Mesh>
 struct CRubus : public IIdentifyTri
 {
     // types for mark/sweep collision resolution
@@ -23,36 +28,117 @@ struct CRubus : public IIdentifyTri
         serial_type serial;
     };
 
-    struct triID_markable
+    // a bin's tris, a slot in binTriIDs. a row that outgrows its slot moves to the end
+    struct binrow_type
     {
-        triID_markable( triID_type t ): triID(t), serial(0) {}
-        triID_type triID;
-        serial_type serial;
+        size_t first = 0;
+        uint32_t count = 0, capacity = 0;
     };
 
-    uint8_t dimension = 1; // works, very inefficiently...
+    // latitude/longitude bins crowd at the poles and need trig for every vert. cube map bins are
+    // six dimension x dimension grids, about equal in area. Reset() after changing
+    enum binning_type { LatLongBinning, CubeBinning };
+    binning_type binning = CubeBinning;
+
+    uint8_t dimension = 1; // picked by Reset() from the tri count
+    size_t stride = 2; // lat/long bin coords run from 0 to dimension
+
+    // ray identifies sphere whcich identifies bin which identifies tri. bins are by BinIndex()
+    std::vector<sph_markable> binSpheres;
+    std::vector<binrow_type> binRows;
+    std::vector<triID_type> binTriIDs;
+    size_t binSlots = 0; // row capacities, so we can tell when moved rows leave too many holes
+    std::vector<serial_type> triSerials; // tri marks, by triID
+
+    // the bins each tri is filed in, kept by Reset(), Refit() and Inflate(). Refit() puts the rows
+    // and spheres Inflate() has changed back into tri order, as Reset() would have them
+    using tribins_type = std::array<binID_type, 4>; // verts and center
+    std::vector<tribins_type> triBins;
+    dirtybits_type inflatedTris, inflatedBins;
+    std::vector<glm::vec3> encloseVecs; // scratch, so Inflate() doesn't allocate
 
-    // ray identifies sphere whcich identifies bin which identifies tri
-    std::map<binID_type, sph_markable> binSpheres;
-    std::multimap<binID_type, triID_markable> binTris;
+    // the tris of each row, slot for slot with binTriIDs, for the ray kernel. a row is re-read from
+    // the model before it's next tested when its members change or Touch() says one has moved
+    CRayTris rowTris;
+    dirtybits_type staleRows;
+    std::vector<glm::vec4> rowBounds; // by bin, a sphere around all of the row's tris as last read
+    std::vector<glm::vec4> blockBounds; // around tiles of the bins' grid
+    dirtybits_type staleBlocks;
+
+    // scratch for Reset(), kept so a rebuild reuses the pages of the last one
+    struct bintri_type
+    {
+        triID_type tri;
+        uint16_t bin; // by BinIndex()
+        uint8_t points; // bit i for resetVecs[ tri ][ i ]
+    };
+    std::vector<std::array<glm::vec3, 4>> resetVecs; // verts and center of each tri
+    std::vector<bintri_type> resetPairs, resetSorted;
+    std::vector<size_t> resetBinPairs; // where each bin's pairs start
+
+    // scratch for IdentifyTris(), reserved by Bind() for packets of up to PacketRays
+    static const size_t PacketRays = 64;
+    std::vector<uint32_t> packetSlots;
+    std::vector<glm::vec3> packetBarys;
+    std::vector<binID_type> packetBins;
+    std::vector<std::pair<float, size_t>> packetRows;
 
     // search t_state
-    IDefineTri* pTriagonalnomial;
+    Mesh* pTriagonalnomial;
     serial_type serial = 0x1234; // for mark-and-sweep algos
 
     CRubus();
     virtual ~CRubus() = default;
 
-    void Bind(IDefineTri* p);
+    void Bind(Mesh* p);
     void Release();
 
     void Reset();
+    void Refit(const dirtybits_type& movedTris); // refiles just these tris, as Reset() would
 
-    void Inflate(sph_markable& sph, binID_type bin, std::multimap<binID_type, glm::vec3> const & binVecs);
+    // refiles a tri that has moved. bins it left shrink to their members, bins it is in grow to hold it
     void Inflate(triID_type triID, const glm::vec3& v0, const glm::vec3 & v1, const glm::vec3 & v2);
+    void Touch(triID_type triID) { for( auto bin : triBins[ triID ] ) staleRows.Set( BinIndex( bin ) ); } // a vert moved
+
+    binID_type BinMake(const glm::vec3& pos) const { return binning == CubeBinning ? CubeBinMake( pos, dimension ) : ::BinMake( pos, dimension ); }
+    binID_type BinAdjust(binID_type bin, int dx, int dy) const { return binning == CubeBinning ? CubeBinAdjust( bin, dx, dy, dimension ) : ::BinAdjust( bin, int8_t(dx), int8_t(dy), dimension ); }
+    uint BinReach() const { return binning == CubeBinning ? dimension : dimension / 4; } // bins in a quarter turn
+    uint BinsAround() const { return binning == CubeBinning ? 4 * dimension : dimension; } // bins in a full turn
+
+    size_t BinCount() const { return binning == CubeBinning ? 6 * size_t( dimension ) * dimension : stride * stride; }
+    size_t BinIndex(binID_type bin) const { return binning == CubeBinning ? bin : size_t( bin >> 8 ) * stride + ( bin & 0xFF ); }
+    binID_type BinOf(size_t index) const { return binning == CubeBinning ? binID_type( index ) : binID_type( ( index / stride ) << 8 | ( index % stride ) ); }
+    bool BinValid(binID_type bin) const { return binning == CubeBinning ? bin < BinCount() : size_t( bin >> 8 ) < stride && size_t( bin & 0xFF ) < stride; }
 
-    // IIdentifyTri
+    // the bins lie in a grid, a face after another for cube bins, which is tiled into blocks
+    size_t GridWidth() const { return binning == CubeBinning ? size_t( dimension ) : stride; }
+    size_t BlockCount() const { return ( ( GridWidth() + 3 ) / 4 ) * ( ( BinCount() / GridWidth() + 3 ) / 4 ); }
+    size_t BlockOf(size_t index) const { return ( index / GridWidth() / 4 ) * ( ( GridWidth() + 3 ) / 4 ) + index % GridWidth() / 4; }
+    template<class Fn>
+    void ForBlockRows(size_t block, Fn fn) const
+    {
+        const size_t width = GridWidth(), tiles = ( width + 3 ) / 4;
+        const size_t u0 = block % tiles * 4, v0 = block / tiles * 4;
+        for( size_t v = v0; v < v0 + 4 && v * width < binRows.size(); v++ )
+            for( size_t u = u0; u < u0 + 4 && u < width; u++ ) fn( v * width + u );
+    }
+
+    // IIdentifyTri. IdentifyTri() finds the first hit in the bins it searches, IdentifyTris() the nearest
     void IdentifyTri(trisearch_type& cxt_out, glm::vec3 const &position_, glm::vec3 const &direction_) final;
+    void IdentifyTris(trisearch_type* cxts_out, const trisearch_type& cxt, glm::vec3 const &position, const glm::vec3* directions, uint n) final;
+
+private:
+    void TriBins(glm::vec3 vecs_out[4], tribins_type& bins_out, triID_type triID);
+    void Enclose(sph_markable& sph_out, const std::vector<glm::vec3>& vecs);
+    void RowAssign(size_t index, const std::vector<triID_type>& tris);
+    void RowInsert(size_t index, triID_type triID);
+    void RowRemove(size_t index, triID_type triID);
+    void RowEnclose(size_t index);
+    void RowCache(size_t index);
+    void RowRead(size_t index, const std::array<glm::vec3, 4>* triVecs = 0); // verts from triVecs by triID when given
+    void BlockBounds(size_t block);
+    void RowMove(size_t index, uint32_t capacity);
+    void Pack();
 };
 
 #endif //_CRUBUS_HPP_
@@ -68,6 +68,7 @@ void gl9DrawElements( GLenum mode, GLsizei count, GLenum type, const GLvoid *ind
 void gl9DrawPixels( GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels );
 void gl9Enable( GLenum cap );
 void gl9EnableClientState( GLenum cap );
+void gl9Finish( void );
 void gl9Flush( void );
 void gl9GenBuffers(GLsizei n, GLuint *buffers);
 void gl9GenTextures( GLsizei n, GLuint *textures );
@@ -89,9 +90,10 @@ void gl9TexImage2D( GLenum target, GLint level, GLint internalFormat, GLsizei wi
 void gl9TexParameteri( GLenum target, GLenum pname, GLint param );
 void gl9VertexPointer( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr );
 void gl9Viewport( GLint x, GLint y, GLsizei width, GLsizei height );
+bool gl9WideIndicies(); // whether GL_UNSIGNED_INT indicies can be drawn, once bound
 
 void gl9RenderPNG(const char *szFilename, int w, int h, std::function<void(void)> fnRender);
-void gl9RenderGIF(const char *szFilename, int w, int h, std::function<void(void)> fnRender, const std::vector<glm::vec3> &colorVerts, int nf, float fps );
+void gl9RenderGIF(const char *szFilename, int w, int h, std::function<void(void)> fnRender, int nf, float fps );
 
 struct gl9ClientStateDisabler
 {
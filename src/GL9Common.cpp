@@ -195,7 +195,7 @@ void gl9RenderPNG(const char *szFilename, int w, int h, std::function<void(void)
     if(fp) fclose(fp);
 }
 
-void gl9RenderGIF( const char *szFilename, int w, int h, std::function<void(void)> fnRender, const std::vector<glm::vec3> &colorVerts, int frames, float fps )
+void gl9RenderGIF( const char *szFilename, int w, int h, std::function<void(void)> fnRender, int frames, float fps )
 {
 
     struct GifFile
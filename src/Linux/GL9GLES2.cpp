@@ -623,6 +623,7 @@ void gl9Enable( GLenum cap ) {
     assert(cap != GL_TEXTURE_2D); // unsupported in ogles2
     ::glEnable( cap );
 }
+void gl9Finish( void ) { ::glFinish(); }
 void gl9Flush( void ) { ::glFlush(); }
 void gl9GenBuffers(GLsizei n, GLuint *buffers) { ::glGenBuffers(n, buffers); }
 void gl9GenTextures( GLsizei n, GLuint *textures ) { ::glGenTextures(  n, textures ); }
@@ -642,3 +643,8 @@ void gl9ReadColor3fv( GLint x, GLint y, GLfloat *f )
 void gl9TexImage2D( GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels ) { ::glTexImage2D(  target,  level,  internalFormat,  width,  height,  border,  format,  type,  pixels ); }
 void gl9TexParameteri( GLenum target, GLenum pname, GLint param ) { ::glTexParameteri(  target,  pname,  param ); }
 void gl9Viewport( GLint x, GLint y, GLsizei width, GLsizei height ) { ::glViewport(  x,  y,  width,  height ); }
+bool gl9WideIndicies()
+{
+    auto szExts = (const char*)glGetString(GL_EXTENSIONS);
+    return szExts && isExtensionSupported( szExts, "GL_OES_element_index_uint" );
+}
@@ -236,6 +236,7 @@ void gl9DrawElements( GLenum mode, GLsizei count, GLenum type, const GLvoid *ind
 void gl9DrawPixels( GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels ) { ::glDrawPixels(  width,  height,  format,  type,  pixels ); }
 void gl9Enable( GLenum cap ) { ::glEnable( cap ); }
 void gl9EnableClientState( GLenum cap ) { ::glEnableClientState(  cap ); }
+void gl9Finish( void ) { ::glFinish(); }
 void gl9Flush( void ) { ::glFlush(); }
 void gl9GenBuffers(GLsizei n, GLuint *buffers) { ::glGenBuffers(n, buffers); }
 void gl9GenTextures( GLsizei n, GLuint *textures ) { ::glGenTextures(  n, textures ); }
@@ -266,3 +267,4 @@ void gl9TexImage2D( GLenum target, GLint level, GLint internalFormat, GLsizei wi
 void gl9TexParameteri( GLenum target, GLenum pname, GLint param ) { ::glTexParameteri(  target,  pname,  param ); }
 void gl9VertexPointer( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr ) { ::glVertexPointer(  size,  type,  stride,  ptr ); }
 void gl9Viewport( GLint x, GLint y, GLsizei width, GLsizei height ) { ::glViewport(  x,  y,  width,  height ); }
+bool gl9WideIndicies() { return true; } // core since 1.1
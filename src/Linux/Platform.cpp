@@ -125,6 +125,7 @@ void AppPlatform::Bind(std::function<void(void)> pfnRebind, std::function<void(v
 
     state.timer.tv_nsec = 1000 * 1000 * TickRateMSec;
     state.timer.tv_sec = 0;
+    frameTargetMSec = TickRateMSec;
 
     setlocale(LC_ALL, "");
     XSupportsLocale();
@@ -9,6 +9,8 @@
 #include <algorithm>
 #include <functional>
 #include <csignal>
+#include <limits>
+#include <ctime>
 
 #include <unistd.h>
 #include <math.h>
@@ -28,6 +30,8 @@
 #include "AppFile.hpp"
 
 #include "RSphere.hpp"
+#include "AppNormalBrusher.hpp"
+#include "AppUploader.hpp"
 
 #define HIREZ
 
@@ -38,10 +42,6 @@
 
 #define RndColour ((float)rand() / (float)RAND_MAX)
 
-//#define SUBDATA_UPDATE_MODE 0 // instant
-//#define SUBDATA_UPDATE_MODE 1 // extents
-#define SUBDATA_UPDATE_MODE 2 // coalesced chicklets
-
 //#define CHECK_SUBDATA
 
 // https://stackoverflow.com/a/23782939
@@ -56,125 +56,168 @@ inline float glLength(const glm::vec3& vec)
 
 //////////////////
 
-// how many tris per 360'
+// how many tris per 360', by default
 #if defined(HIREZ)
-const uint DivisionSize = 60;
+const uint DefaultDivisionSize = 60;
 #else
-const uint DivisionSize = 20;
+const uint DefaultDivisionSize = 20;
 #endif
 
-// make 4 chicklets per 360'
-const uint16_t ChickletBitSize = std::max<uint16_t>( 1, ceillog2( DivisionSize >> 2 ) );
-
-template<class T>
-void RSphere::BufferSubData_Chicklet(
-    const GLenum& target,
-    const std::vector<T>& vec,
-    const std::set<uint16_t>& markings,
-    const uint16_t& chickletBitSize
-)
-{
-    if(markings.size() == 0) return;
-
-    const auto cItems = 1 << chickletBitSize;
-    const auto cMask = cItems -1;
-    const auto iBytes = sizeof(T);
-    const auto cBytes = cItems * iBytes;
-    const auto vBytes = iBytes * vec.size();
-    for( const auto& i : markings )
-    {
-        const auto bStart = (i & ~cMask) * iBytes; // chicklets are item aligned
-        const auto bCount = std::min<int>( vBytes, bStart + cBytes ) - bStart; // clip
-#ifdef DEBUG
-        assert( bCount <= vBytes );
-#endif // DEBUG
-#if defined(CHECK_SUBDATA)
-        AppLog::Info( __FILENAME__, "%s %4d %4d    %8X", __func__, bStart, bCount, bStart + (uint8_t*)vec.data() );
-#endif // CHECK_SUBDATA
+// tri count grows as divisions^2, so the id type limits the divisions
+const uint MinDivisionSize = 8;
+const uint MaxDivisionSize = std::min<uint>( 1024, uint( std::sqrt( float( TriIDEnd ) ) ) - 1 );
 
-        gl9BufferSubData( target, bStart, bCount, bStart + (uint8_t*)vec.data() );
+// and vert count as divisions^2 / 2, so 16 bit indicies limit them further
+const size_t MaxNarrowVerts = std::numeric_limits<uint16_t>::max();
+const uint MaxNarrowDivisionSize = std::min<uint>( MaxDivisionSize, uint( std::sqrt( 2.f * float( MaxNarrowVerts ) ) ) );
 
-        bytesUpdated += bCount;
-    }
+template<class A>
+void RSphere::UpdateItem(AppUploadStream& stream, const A& vec, const vertID_type& i)
+{
+    stream.Update( i, &vec[ i ] );
 }
 
 bool RSphere::CheatSphereOnly = true;
 
+uint RSphere::divisionSize = DefaultDivisionSize;
+bool RSphere::wideIndicies = true;
+
 uint RSphere::GetDivisions() const
 {
-    return DivisionSize;
+    return divisionSize;
 }
 
-void RSphere::Backup()
+uint RSphere::SetDivisions(uint divisions)
 {
-    posVerts_backup = posVerts;
-    colorVerts_backup = colorVerts;
+    const uint maxDivisions = wideIndicies ? MaxDivisionSize : MaxNarrowDivisionSize;
+    if( divisions > maxDivisions && maxDivisions < MaxDivisionSize )
+        AppLog::Warn( __FILENAME__, "no 32 bit indicies, so %u divisions at most", maxDivisions );
+
+    divisionSize = std::max( MinDivisionSize, std::min( maxDivisions, divisions ) );
+    return divisionSize;
 }
 
-void RSphere::Reset(bool fromBackup)
+void RSphere::StrokeBegin()
 {
-    posVerts.clear();
-    indTriVerts.clear();
-    normVerts.clear();
-    colorVerts.clear();
-    normTris.clear();
+    journal.Begin();
+}
 
-    const uint divisions = GetDivisions();
+void RSphere::StrokeCommit()
+{
+    journal.Commit();
+}
+
+bool RSphere::Undo()
+{
+    return Replay( &AppJournal::Undo );
+}
+
+bool RSphere::Redo()
+{
+    return Replay( &AppJournal::Redo );
+}
 
-    if(fromBackup)
+// swaps the journalled verts in place, then fixes the normals, collision bins and buffers around them
+bool RSphere::Replay(replay_type fnReplay)
+{
+    AppJournal::arrays_type arrays = { &posVerts, &colorVerts };
+    bool replayed = (journal.*fnReplay)( arrays, [&] (AppJournal::channel_type c, vertID_type v) {
+        if( c == AppJournal::PosChannel ) { movedVerts.Set( v ); return; }
+        if( storage == InterleavedStorage ) { Interleave( v ); UpdateItem( vertStream, interVerts, v ); }
+        else UpdateItem( colorStream, colorVerts, v );
+    } );
+    if( !replayed ) return false;
+
+    FinalizeMoved();
+
+    UpdatePosTick();
+    UpdateNormalTick();
+    UpdateColorTick();
+    return true;
+}
+
+// the pickers are told about the tris around a vert as soon as it moves. the bvh refits them
+// every tick, the rubus re-reads their rows before testing them again, and the id buffer
+// re-rasterizes their tiles before the next lookup
+void RSphere::Moved(vertID_type v)
+{
+    movedVerts.Set( v );
+    for( auto t = vertTris.begin( v ); t != vertTris.end( v ); ++t )
     {
-        posVerts = posVerts_backup;
+        if( picking == BvhPicking ) bvh.Touch( *t );
+        else if( picking == BufferPicking ) idBuffer.Touch( *t );
+        else rubus.Touch( *t );
     }
-    else
-    {
-        int m0 = CheatSphereOnly ? 0 : rand() % 5;
+}
+
+// renormalize and refit the collision bins around the verts moved since the last finalize
+void RSphere::FinalizeMoved()
+{
+    if( !movedVerts.Any() ) return;
+
+    AppNormalBrusher<RSphere>::Renormalize( *this, movedVerts, movedTris, renormVerts );
+    if( picking == BvhPicking ) bvh.Refit( movedTris );
+    else if( picking == BufferPicking ) idBuffer.Refit( movedTris );
+    else rubus.Refit( movedTris );
+
+    movedVerts.Clear();
+}
 
-        const int N = 2;
+void RSphere::Reset()
+{
+    std::vector<glm::vec3> verts; // built flat, then paged
+    indTriVerts.clear();
+    normTris.clear();
 
-        int k[N];
-        for(int i=0; i<N; i++) k[i] = 1 + rand() % 5;
+    const uint divisions = GetDivisions();
 
-        float c[N];
-        for(int i=0; i<N; i++) c[i] = float( k[i] ) * .2f;
+    int m0 = CheatSphereOnly ? 0 : rand() % 5;
 
-        // build the points from a 3d spiral created by moving
-        // a point around rotation and inclination axis.
-        glm::vec3 axisInclination( 0, 1, 0 );
-        glm::vec3 axisRotation( 1, 0, 0 );
+    const int N = 2;
 
-        float angleRotation = float( M_PI ) / float( divisions );
-        glm::quat quatRotation = glm::angleAxis( angleRotation, axisRotation );
-        while( true )
-        {
-            float angleInclination = float( M_PI ) * ( float( posVerts.size() / float( divisions * divisions ) ) );
+    int k[N];
+    for(int i=0; i<N; i++) k[i] = 1 + rand() % 5;
 
-            // stop when we're pointing the other way
-            if( std::abs( angleInclination - float( M_PI ) / 2 ) < .01f ) break; // hack: /2
+    float c[N];
+    for(int i=0; i<N; i++) c[i] = float( k[i] ) * .2f;
 
-            float x;
-            switch(m0)
-            {
-                case 1: x = std::abs( std::pow( angleInclination, 2 * c[0] ) - c[1] ); break;
-                case 2: x = 2 * std::pow( angleInclination, 2 * c[0] ); break;
-                case 3: x = std::pow( angleInclination - c[0] / 2, - c[1] / 2 ); break;
-                default: x = 1;
-            }
+    // build the points from a 3d spiral created by moving
+    // a point around rotation and inclination axis.
+    glm::vec3 axisInclination( 0, 1, 0 );
+    glm::vec3 axisRotation( 1, 0, 0 );
 
-            const glm::vec3 unitVector( x, 0, 0 );
-            glm::quat quatNet =
-                glm::angleAxis( angleInclination, glm::normalize( glm::cross( axisRotation, axisInclination )));
-            glm::vec3 vert = quatNet * unitVector * glm::conjugate( quatNet );
-            posVerts.push_back( vert );
+    float angleRotation = float( M_PI ) / float( divisions );
+    glm::quat quatRotation = glm::angleAxis( angleRotation, axisRotation );
+    while( true )
+    {
+        float angleInclination = float( M_PI ) * ( float( verts.size() / float( divisions * divisions ) ) );
 
-            axisRotation = glm::normalize( quatRotation * axisRotation * glm::conjugate( quatRotation ));
-            axisInclination = glm::normalize( quatRotation * axisInclination * glm::conjugate( quatRotation ));
+        // stop when we're pointing the other way
+        if( std::abs( angleInclination - float( M_PI ) / 2 ) < .01f ) break; // hack: /2
+
+        float x;
+        switch(m0)
+        {
+            case 1: x = std::abs( std::pow( angleInclination, 2 * c[0] ) - c[1] ); break;
+            case 2: x = 2 * std::pow( angleInclination, 2 * c[0] ); break;
+            case 3: x = std::pow( angleInclination - c[0] / 2, - c[1] / 2 ); break;
+            default: x = 1;
         }
+
+        const glm::vec3 unitVector( x, 0, 0 );
+        glm::quat quatNet =
+            glm::angleAxis( angleInclination, glm::normalize( glm::cross( axisRotation, axisInclination )));
+        glm::vec3 vert = quatNet * unitVector * glm::conjugate( quatNet );
+        verts.push_back( vert );
+
+        axisRotation = glm::normalize( quatRotation * axisRotation * glm::conjugate( quatRotation ));
+        axisInclination = glm::normalize( quatRotation * axisInclination * glm::conjugate( quatRotation ));
     }
 
     // build body from triangles: endcaps made from fans, connected by a strip
     uint firstPoint = 0;
     uint secondPoint = 1;
-    uint lastPoint = posVerts.size()-1;
+    uint lastPoint = verts.size()-1;
     for(uint i=secondPoint;i<lastPoint;i++)
     {
         // 3 parts: trifans over one rotation at endcaps and quads in middle
@@ -196,7 +239,7 @@ void RSphere::Reset(bool fromBackup)
     for(uint i=0; i<indTriVerts.size(); i++)
     {
         uint p0 = indTriVerts[i].x, p1 = indTriVerts[i].y, p2 = indTriVerts[i].z;
-        if( !( p0 < posVerts.size() && p1 < posVerts.size() && p2 < posVerts.size()))
+        if( !( p0 < verts.size() && p1 < verts.size() && p2 < verts.size()))
         {
             printf("tri ind err %u: %u %u %u\n", i, p0,p1,p2);
             raise(SIGTRAP); //assert(false);
@@ -204,23 +247,28 @@ void RSphere::Reset(bool fromBackup)
     }
 
     IndTriAdjTris( indTriAdjTris, indTriVerts );
+    IndVertTris( vertTris, verts.size(), indTriVerts );
+
+    movedVerts.Resize( verts.size() );
+    movedTris.Resize( indTriVerts.size() );
+    renormVerts.Resize( verts.size() );
 
-    normEffectVerts.resize( posVerts.size() );
-    normVerts.resize( posVerts.size() );
+    normEffectVerts.resize( verts.size() );
+    std::vector<glm::vec3> norms( verts.size() );
     normTris.resize( indTriVerts.size() );
-    TriVertNormals( normVerts, normTris, indTriVerts, posVerts );
+    TriVertNormals( norms, normTris, indTriVerts, verts );
 
-    if(fromBackup)
-    {
-        colorVerts = colorVerts_backup;
-    }
-    else
-    {
-        colorVerts.resize( posVerts.size() );
-        std::generate( colorVerts.begin(), colorVerts.end(),
-                       []() -> glm::vec3 { return glm::vec3(RndColour, RndColour, RndColour); }
-        );
-    }
+    std::vector<glm::vec3> colors( verts.size() );
+    std::generate( colors.begin(), colors.end(),
+                   []() -> glm::vec3 { return glm::vec3(RndColour, RndColour, RndColour); }
+    );
+
+    posVerts.assign( verts );
+    normVerts.assign( norms );
+    colorVerts.assign( colors );
+    snapshotTris.reset();
+
+    journal.Resize( posVerts.size() ); // new topology, old history is meaningless
 
 #ifdef DEBUG
     printf("sphere %zu verts\n", posVerts.size());
@@ -230,61 +278,244 @@ void RSphere::Reset(bool fromBackup)
 
 void RSphere::Bind()
 {
-    if(posVerts.size() == 0)
+    // GLES2 draws 32 bit indicies only with OES_element_index_uint, so without it shrink a model that needs them
+    wideIndicies = gl9WideIndicies();
+    if( !wideIndicies && posVerts.size() > MaxNarrowVerts )
     {
+        SetDivisions( divisionSize );
         Reset();
-        Backup();
     }
+    if(posVerts.size() == 0) Reset();
 
-    rubus.Bind(this);
+    if( picking == BvhPicking ) bvh.Bind(this);
+    else if( picking == BufferPicking ) idBuffer.Bind(this);
+    else rubus.Bind(this);
 
-    gl9GenBuffers( 1, &boPos );
-    gl9BindBuffer( GL_ARRAY_BUFFER, boPos );
-    gl9BufferData( GL_ARRAY_BUFFER, posVerts.size() * sizeof(glm::vec3), posVerts.data(), GL_STATIC_DRAW );
+    // until calibrated, make 4 chicklets per 360'
+    if( !uploadCalibrated )
+        uploadSettings.chickletBitSize = std::max<uint16_t>( 1, ceillog2( GetDivisions() >> 2 ) );
+
+    BindStreams();
 
     gl9GenBuffers( 1, &boIndicies );
     gl9BindBuffer( GL_ELEMENT_ARRAY_BUFFER, boIndicies );
-    gl9BufferData( GL_ELEMENT_ARRAY_BUFFER, indTriVerts.size() * sizeof(ind3_type), indTriVerts.data(), GL_STATIC_DRAW );
+    if( sizeof(ind3_type::base_type) > sizeof(uint16_t) && posVerts.size() <= MaxNarrowVerts )
+    {
+        // small model in a wide-id build: pack the indicies to save bandwidth
+        std::vector<ind3_tmpl<uint16_t>> indPacked;
+        indPacked.reserve( indTriVerts.size() );
+        for( auto& tri : indTriVerts ) indPacked.push_back( ind3_tmpl<uint16_t>( uint16_t(tri.x), uint16_t(tri.y), uint16_t(tri.z) ) );
+        gl9BufferData( GL_ELEMENT_ARRAY_BUFFER, indPacked.size() * sizeof(ind3_tmpl<uint16_t>), indPacked.data(), GL_STATIC_DRAW );
+        indTypeID = ind3_tmpl<uint16_t>::base_typeid;
+    }
+    else
+    {
+        assert( wideIndicies || sizeof(ind3_type::base_type) == sizeof(uint16_t) );
+        gl9BufferData( GL_ELEMENT_ARRAY_BUFFER, indTriVerts.size() * sizeof(ind3_type), indTriVerts.data(), GL_STATIC_DRAW );
+        indTypeID = ind3_type::base_typeid;
+    }
     gl9BindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
-
-    gl9GenBuffers( 1, &boNormals );
-    gl9BindBuffer( GL_ARRAY_BUFFER, boNormals );
-    gl9BufferData( GL_ARRAY_BUFFER, normVerts.size() * sizeof(glm::vec3), normVerts.data(), GL_STATIC_DRAW );
-
-    gl9GenBuffers( 1, &boColor );
-    gl9BindBuffer( GL_ARRAY_BUFFER, boColor );
-    gl9BufferData( GL_ARRAY_BUFFER, colorVerts.size() * sizeof(glm::vec3), colorVerts.data(), GL_STATIC_DRAW );
-    gl9BindBuffer( GL_ARRAY_BUFFER, 0 );
 }
 
 void RSphere::Release()
 {
-    if(boPos) { gl9DeleteBuffers( 1, &boPos ); }
+    ReleaseStreams();
     if(boIndicies) { gl9DeleteBuffers( 1, &boIndicies ); }
-    if(boNormals) { gl9DeleteBuffers( 1, &boNormals ); }
-    if(boColor) { gl9DeleteBuffers( 1, &boColor ); }
+    boIndicies = 0;
 
     rubus.Release();
+    bvh.Release();
+    idBuffer.Release();
+}
+
+void RSphere::SetPicking(picking_type p)
+{
+    if( p == picking ) return;
+    if( picking == BvhPicking ) bvh.Release();
+    else if( picking == BufferPicking ) idBuffer.Release();
+    else rubus.Release();
+
+    picking = p;
+    if( picking == BvhPicking ) bvh.Bind(this);
+    else if( picking == BufferPicking ) idBuffer.Bind(this);
+    else rubus.Bind(this);
+}
+
+void RSphere::BindStreams()
+{
+    if(storage == InterleavedStorage)
+    {
+        interVerts.resize( posVerts.size() );
+        for(vertID_type v = 0; v < posVerts.size(); v++) Interleave(v);
+        vertStream.Bind( interVerts.data(), sizeof(vertex_type), interVerts.size(), &uploadSettings, &uploadStats );
+    }
+    else
+    {
+        posStream.Bind( posVerts, &uploadSettings, &uploadStats );
+        normStream.Bind( normVerts, &uploadSettings, &uploadStats );
+        colorStream.Bind( colorVerts, &uploadSettings, &uploadStats );
+    }
+}
+
+void RSphere::ReleaseStreams()
+{
+    posStream.Release();
+    normStream.Release();
+    colorStream.Release();
+    vertStream.Release();
+    interVerts.clear();
+}
+
+// Runs the same synthetic stroke through each upload strategy on the bound buffers and keeps the fastest.
+// The stroke only re-uploads unchanged data so the model is unaffected.
+// Draws are not interleaved so stalls on in-flight buffers are not measured, only the driver's copy costs.
+void RSphere::CalibrateUploads()
+{
+    if( indTriAdjTris.size() == 0 ) return;
+
+    const uint kTicks = 24;
+    const uint kPasses = 2; // best of
+
+    // a brush-sized patch of tris per tick, walking across the surface
+    const size_t patchTris = std::min<size_t>( 1024, std::max<size_t>( 16, indTriVerts.size() / 200 ) );
+    std::vector<std::vector<triID_type>> patches( kTicks );
+    {
+        std::vector<uint8_t> visited( indTriVerts.size(), 0 );
+        std::vector<triID_type> touched;
+        triID_type center = triID_type( rand() % indTriVerts.size() );
+        for( auto& patch : patches )
+        {
+            // breadth first from the center
+            patch.push_back( center );
+            visited[ center ] = 1;
+            for( size_t i = 0; i < patch.size() && patch.size() < patchTris; i++ )
+            {
+                auto adj = indTriAdjTris[ patch[ i ] ];
+                for( triID_type a : { adj.x, adj.y, adj.z } )
+                    if( a != TriIDEnd && !visited[ a ] && patch.size() < patchTris ) { visited[ a ] = 1; patch.push_back( a ); }
+            }
+            for( auto t : patch ) visited[ t ] = 0;
+
+            // step a few tris along, roughly in one direction
+            for( uint s = 0; s < 4; s++ )
+                if( indTriAdjTris[ center ].x != TriIDEnd ) center = indTriAdjTris[ center ].x;
+        }
+    }
+
+    auto fnTime = [&] () -> float
+    {
+        float best = std::numeric_limits<float>::max();
+        for( uint pass = 0; pass < kPasses; pass++ )
+        {
+            struct timespec spec0, spec1;
+            gl9Finish();
+            clock_gettime( CLOCK_MONOTONIC, &spec0 );
+            for( auto& patch : patches )
+            {
+                for( auto t : patch ) { UpdatePos( t ); UpdateColor( t ); }
+                UpdatePosTick();
+                UpdateColorTick();
+            }
+            gl9Finish();
+            clock_gettime( CLOCK_MONOTONIC, &spec1 );
+            best = std::min( best, float(spec1.tv_sec - spec0.tv_sec) + float(spec1.tv_nsec - spec0.tv_nsec) / 1E+9f );
+        }
+        return best;
+    };
+
+    std::vector<AppUploadSettings> candidates;
+    {
+        AppUploadSettings cand;
+        cand.strategy = AppUploadSettings::InstantStrategy;
+        candidates.push_back( cand );
+
+        cand.chickletBitSize = std::max<uint16_t>( 1, ceillog2( GetDivisions() >> 2 ) );
+        cand.strategy = AppUploadSettings::ExtentsStrategy;
+        candidates.push_back( cand );
+
+        cand.strategy = AppUploadSettings::ChickletStrategy;
+        for( uint16_t bits = 2; bits <= 8 && (size_t(1) << bits) < posVerts.size(); bits++ )
+        {
+            cand.chickletBitSize = bits;
+            cand.copies = 1;
+            cand.orphanFraction = 1.1f;
+            candidates.push_back( cand );
+            cand.copies = 2; // streaming ring
+            cand.orphanFraction = .5f;
+            candidates.push_back( cand );
+        }
+    }
+
+    const AppUploadStats statsSaved = uploadStats;
+    size_t bestIndex = 0;
+    float bestSec = std::numeric_limits<float>::max();
+    for( size_t i = 0; i < candidates.size(); i++ )
+    {
+        ReleaseStreams();
+        uploadSettings = candidates[ i ];
+        BindStreams();
+
+        float sec = fnTime();
+        AppLog::Info( __FILENAME__, "upload %-9s bits %u copies %u: %.3f ms", uploadSettings.StrategyName(),
+                      uploadSettings.chickletBitSize, uploadSettings.copies, sec * 1000.f );
+        if( sec < bestSec ) { bestSec = sec; bestIndex = i; }
+    }
+
+    ReleaseStreams();
+    uploadSettings = candidates[ bestIndex ];
+    BindStreams();
+    uploadStats = statsSaved; // don't report the calibration traffic
+    uploadCalibrated = true;
+
+    AppLog::Info( __FILENAME__, "upload strategy %s bits %u copies %u (%.3f ms)", uploadSettings.StrategyName(),
+                  uploadSettings.chickletBitSize, uploadSettings.copies, bestSec * 1000.f );
 }
 
 void RSphere::Render()
 {
+    if(storage == InterleavedStorage)
+    {
+        RenderInterleaved();
+        return;
+    }
+
     gl9ClientStateDisabler objectVertArrState( GL_VERTEX_ARRAY );
-    gl9BufferUnbinder objectVerts( GL_ARRAY_BUFFER, boPos );
+    gl9BufferUnbinder objectVerts( GL_ARRAY_BUFFER, posStream.Front() );
     gl9VertexPointer( 3, GL_FLOAT, 0, nullptr );
 
 #if !defined(OGL1)
     gl9ClientStateDisabler objNormalArrState( GL_NORMAL_ARRAY ); // lighting
-    gl9BufferUnbinder objectNormals(GL_ARRAY_BUFFER, boNormals);
+    gl9BufferUnbinder objectNormals(GL_ARRAY_BUFFER, normStream.Front());
     gl9VertexPointer( 3, GL_FLOAT, 0, NULL );
 #endif // OGL1
 
     gl9ClientStateDisabler objColorArrState( GL_COLOR_ARRAY );
-    gl9BufferUnbinder objectColor(GL_ARRAY_BUFFER, boColor);
+    gl9BufferUnbinder objectColor(GL_ARRAY_BUFFER, colorStream.Front());
     gl9ColorPointer( 3, GL_FLOAT, 0, NULL );
 
     gl9BufferUnbinder objectTriIndicies(GL_ELEMENT_ARRAY_BUFFER, boIndicies);
-    gl9DrawElements( GL_TRIANGLES, (GLsizei)indTriVerts.size() * 3, ind3_type::base_typeid, nullptr );
+    gl9DrawElements( GL_TRIANGLES, (GLsizei)indTriVerts.size() * 3, indTypeID, nullptr );
+}
+void RSphere::RenderInterleaved()
+{
+    const GLsizei stride = sizeof(vertex_type);
+
+    // one buffer, three attribute streams
+    gl9BufferUnbinder objectVerts( GL_ARRAY_BUFFER, vertStream.Front() );
+
+    gl9ClientStateDisabler objectVertArrState( GL_VERTEX_ARRAY );
+    gl9VertexPointer( 3, GL_FLOAT, stride, (GLvoid*)offsetof(vertex_type, pos) );
+
+#if !defined(OGL1)
+    gl9ClientStateDisabler objNormalArrState( GL_NORMAL_ARRAY ); // lighting
+    gl9VertexPointer( 3, GL_FLOAT, stride, (GLvoid*)offsetof(vertex_type, norm) );
+#endif // OGL1
+
+    gl9ClientStateDisabler objColorArrState( GL_COLOR_ARRAY );
+    gl9ColorPointer( 3, GL_FLOAT, stride, (GLvoid*)offsetof(vertex_type, color) );
+
+    gl9BufferUnbinder objectTriIndicies(GL_ELEMENT_ARRAY_BUFFER, boIndicies);
+    gl9DrawElements( GL_TRIANGLES, (GLsizei)indTriVerts.size() * 3, indTypeID, nullptr );
 }
 void RSphere::RenderCollisionBody(glm::vec3 axisIn, glm::vec3 axisUp, glm::vec3 color)
 {
@@ -293,9 +524,10 @@ void RSphere::RenderCollisionBody(glm::vec3 axisIn, glm::vec3 axisUp, glm::vec3
     gl9PushAttrib( GL_POLYGON_MODE );
     {
         gl9Color3fv(glm::value_ptr(color));
-        for( auto iter = rubus.binSpheres.begin(); iter != rubus.binSpheres.end(); ++iter )
+        for( size_t b = 0; b < rubus.binSpheres.size(); b++ )
         {
-            gl9Circle( axisIn, axisUp, iter->second.center, iter->second.radius, 10 );
+            if( rubus.binRows[ b ].count == 0 ) continue;
+            gl9Circle( axisIn, axisUp, rubus.binSpheres[ b ].center, rubus.binSpheres[ b ].radius, 10 );
         }
     }
     gl9PopAttrib();
@@ -326,71 +558,70 @@ void RSphere::RenderNormals()
 void RSphere::BrushPos(triID_type triID, glm::vec3 const &normDeform, float const & k)
 {
     ind3_type tri = indTriVerts[ triID ];
-    posVerts[ tri.x ] += normDeform * k;
-    posVerts[ tri.y ] += normDeform * k;
-    posVerts[ tri.z ] += normDeform * k;
+    journal.Record( AppJournal::PosChannel, tri.x, posVerts[ tri.x ] );
+    journal.Record( AppJournal::PosChannel, tri.y, posVerts[ tri.y ] );
+    journal.Record( AppJournal::PosChannel, tri.z, posVerts[ tri.z ] );
+    posVerts.Write( tri.x ) += normDeform * k;
+    posVerts.Write( tri.y ) += normDeform * k;
+    posVerts.Write( tri.z ) += normDeform * k;
+    Moved( tri.x );
+    Moved( tri.y );
+    Moved( tri.z );
 
     // hack to fix endcaps
-    const auto last = posVerts.size() -1;
+    const vertID_type last = vertID_type( posVerts.size() -1 );
     if(tri.x == 0 || tri.y == 0 || tri.z == 0)
     {
+        journal.Record( AppJournal::PosChannel, 0, posVerts[ 0 ] );
         glm::vec3 sum;
-        for(uint i=1; i<DivisionSize; i++) sum += posVerts[ i ];
-        posVerts[0] = sum / float(DivisionSize);
+        for(uint i=1; i<divisionSize; i++) sum += posVerts[ i ];
+        posVerts.Write( 0 ) = sum / float(divisionSize);
+        Moved( 0 );
     }
     else if(tri.x == last || tri.y == last || tri.z == last)
     {
+        journal.Record( AppJournal::PosChannel, last, posVerts[ last ] );
         glm::vec3 sum;
-        for(uint i=1; i<DivisionSize; i++) sum += posVerts[ last -i ];
-        posVerts[last] = sum / float(DivisionSize);
+        for(uint i=1; i<divisionSize; i++) sum += posVerts[ last -i ];
+        posVerts.Write( last ) = sum / float(divisionSize);
+        Moved( last );
     }
 
     UpdatePos(triID);
-    rubus.Inflate(triID, posVerts[ tri.x ], posVerts[ tri.y ], posVerts[ tri.z ]);
+    if( picking == RubusPicking ) rubus.Inflate(triID, posVerts[ tri.x ], posVerts[ tri.y ], posVerts[ tri.z ]);
 }
 void RSphere::UpdatePos(triID_type triID)
 {
     ind3_type tri = indTriVerts[ triID ];
 
-#if (SUBDATA_UPDATE_MODE==0)
-    gl9BindBuffer( GL_ARRAY_BUFFER, boPos );
-    gl9BufferSubData( GL_ARRAY_BUFFER, tri.x * sizeof( glm::vec3 ), sizeof( glm::vec3 ), &posVerts[tri.x] );
-    gl9BufferSubData( GL_ARRAY_BUFFER, tri.y * sizeof( glm::vec3 ), sizeof( glm::vec3 ), &posVerts[tri.y] );
-    gl9BufferSubData( GL_ARRAY_BUFFER, tri.z * sizeof( glm::vec3 ), sizeof( glm::vec3 ), &posVerts[tri.z] );
-    gl9BindBuffer( GL_ARRAY_BUFFER, 0 );
-    bytesUpdated += sizeof(glm::vec3) * 3;
-#else
-    // async update
-    const uint16_t chickletMask = (1 << ChickletBitSize) -1;
-    triUpdateSet.insert( tri.x & ~chickletMask );
-    triUpdateSet.insert( tri.y & ~chickletMask );
-    triUpdateSet.insert( tri.z & ~chickletMask );
-#endif
+    if(storage == InterleavedStorage)
+    {
+        Interleave( tri.x );
+        Interleave( tri.y );
+        Interleave( tri.z );
+        UpdateItem( vertStream, interVerts, tri.x );
+        UpdateItem( vertStream, interVerts, tri.y );
+        UpdateItem( vertStream, interVerts, tri.z );
+    }
+    else
+    {
+        UpdateItem( posStream, posVerts, tri.x );
+        UpdateItem( posStream, posVerts, tri.y );
+        UpdateItem( posStream, posVerts, tri.z );
+    }
 }
 void RSphere::UpdatePosTick()
 {
-    if(triUpdateSet.size() == 0) return;
-
-    gl9BindBuffer( GL_ARRAY_BUFFER, boPos );
-
-#if (SUBDATA_UPDATE_MODE==0)
-    assert( false ); // already updated
-#elif (SUBDATA_UPDATE_MODE==1)
-    auto s = *triUpdateSet.begin();
-    auto e = *triUpdateSet.rbegin();
-    gl9BufferSubData( GL_ARRAY_BUFFER, sizeof(glm::vec3) * s, sizeof(glm::vec3) * (e -s +1), &posVerts[s] );
-    bytesUpdated += sizeof(glm::vec3) * (e -s +1);
-#elif (SUBDATA_UPDATE_MODE==2)
-    BufferSubData_Chicklet( GL_ARRAY_BUFFER, posVerts, triUpdateSet, ChickletBitSize );
-#endif
-
-    gl9BindBuffer( GL_ARRAY_BUFFER, 0 );
+    if( picking == BvhPicking ) bvh.Refit(); // so this tick's picks see where the tris went
 
-    triUpdateSet.clear();
+    if(storage == InterleavedStorage)
+        vertStream.Tick( interVerts.data() );
+    else
+        posStream.Tick( posVerts );
 }
 void RSphere::UpdatePosFinalize()
 {
-
+    FinalizeMoved();
 }
 
 void RSphere::BrushZ(triID_type triID, float const &k)
@@ -399,15 +630,58 @@ void RSphere::BrushZ(triID_type triID, float const &k)
     normEffectVerts[ tri.x ] = std::max( normEffectVerts[ tri.x ], k );
     normEffectVerts[ tri.y ] = std::max( normEffectVerts[ tri.y ], k );
     normEffectVerts[ tri.z ] = std::max( normEffectVerts[ tri.z ], k );
-    posVerts[ tri.x ] = posVerts_backup[ tri.x ] + normTris[triID] * normEffectVerts[ tri.x ];
-    posVerts[ tri.y ] = posVerts_backup[ tri.y ] + normTris[triID] * normEffectVerts[ tri.y ];
-    posVerts[ tri.z ] = posVerts_backup[ tri.z ] + normTris[triID] * normEffectVerts[ tri.z ];
+    journal.Record( AppJournal::PosChannel, tri.x, posVerts[ tri.x ] );
+    journal.Record( AppJournal::PosChannel, tri.y, posVerts[ tri.y ] );
+    journal.Record( AppJournal::PosChannel, tri.z, posVerts[ tri.z ] );
+    posVerts.Write( tri.x ) = StrokeStartPos( tri.x ) + normTris[triID] * normEffectVerts[ tri.x ];
+    posVerts.Write( tri.y ) = StrokeStartPos( tri.y ) + normTris[triID] * normEffectVerts[ tri.y ];
+    posVerts.Write( tri.z ) = StrokeStartPos( tri.z ) + normTris[triID] * normEffectVerts[ tri.z ];
+    Moved( tri.x );
+    Moved( tri.y );
+    Moved( tri.z );
     UpdatePos(triID);
-    rubus.Inflate(triID, posVerts[ tri.x ], posVerts[ tri.y ], posVerts[ tri.z ]);
+    if( picking == RubusPicking ) rubus.Inflate(triID, posVerts[ tri.x ], posVerts[ tri.y ], posVerts[ tri.z ]);
 }
-void RSphere::UpdateNormalFinalize()
+void RSphere::UpdateNorm(vertID_type v)
 {
+    if(storage == InterleavedStorage)
+    {
+        Interleave( v );
+        UpdateItem( vertStream, interVerts, v );
+    }
+    else
+        UpdateItem( normStream, normVerts, v );
+}
+size_t RSphere::UploadBacklog(uint uploads) const
+{
+    if(storage == InterleavedStorage) return uploads ? vertStream.Backlog() : 0;
 
+    size_t backlog = 0;
+    if( uploads & PosUpload ) backlog += posStream.Backlog();
+    if( uploads & NormalUpload ) backlog += normStream.Backlog();
+    if( uploads & ColorUpload ) backlog += colorStream.Backlog();
+    return backlog;
+}
+void RSphere::UpdateAllNorms()
+{
+    if(storage == InterleavedStorage)
+    {
+        for(vertID_type v = 0; v < posVerts.size(); v++) Interleave(v);
+        vertStream.MarkAll();
+    }
+    else
+        normStream.MarkAll();
+}
+void RSphere::UpdateNormalTick()
+{
+    if(storage == InterleavedStorage)
+        vertStream.Tick( interVerts.data() );
+    else
+        normStream.Tick( normVerts );
+}
+void RSphere::UpdateNormalFinalize()
+{
+    UpdateNormalTick();
 }
 
 void RSphere::BrushColor(triID_type triID, glm::vec3 const & color, float const blend)
@@ -419,54 +693,45 @@ void RSphere::BrushColor(triID_type triID, glm::vec3 const & color, float const
 #endif // CHECK_SUBDATA
 
 #if !defined(OGL1) // OGL1 tri color set from 3rd vert only
-    colorVerts[ tri.x ] = blend * color + (1.f - blend) * colorVerts[ tri.x ];
-    colorVerts[ tri.y ] = blend * color + (1.f - blend) * colorVerts[ tri.y ];
+    journal.Record( AppJournal::ColorChannel, tri.x, colorVerts[ tri.x ] );
+    journal.Record( AppJournal::ColorChannel, tri.y, colorVerts[ tri.y ] );
+    colorVerts.Write( tri.x ) = blend * color + (1.f - blend) * colorVerts[ tri.x ];
+    colorVerts.Write( tri.y ) = blend * color + (1.f - blend) * colorVerts[ tri.y ];
 #endif // OGL1
-    colorVerts[ tri.z ] = blend * color + (1.f - blend) * colorVerts[ tri.z ];
+    journal.Record( AppJournal::ColorChannel, tri.z, colorVerts[ tri.z ] );
+    colorVerts.Write( tri.z ) = blend * color + (1.f - blend) * colorVerts[ tri.z ];
     UpdateColor(triID);
 }
 void RSphere::UpdateColor(triID_type triID)
 {
     ind3_type tri = indTriVerts[ triID ];
 
-#if (SUBDATA_UPDATE_MODE==0)
-    gl9BindBuffer( GL_ARRAY_BUFFER, boColor );
+    if(storage == InterleavedStorage)
+    {
 #if !defined(OGL1) // OGL1 tri color set from 3rd vert only
-    gl9BufferSubData( GL_ARRAY_BUFFER, tri.x * sizeof( glm::vec3 ), sizeof( glm::vec3 ), &colorVerts[tri.x] );
-    gl9BufferSubData( GL_ARRAY_BUFFER, tri.y * sizeof( glm::vec3 ), sizeof( glm::vec3 ), &colorVerts[tri.y] );
-    bytesUpdated += sizeof(glm::vec3) * 2;
+        Interleave( tri.x );
+        Interleave( tri.y );
+        UpdateItem( vertStream, interVerts, tri.x );
+        UpdateItem( vertStream, interVerts, tri.y );
 #endif // OGL1
-    gl9BufferSubData( GL_ARRAY_BUFFER, tri.z * sizeof( glm::vec3 ), sizeof( glm::vec3 ), &colorVerts[tri.z] );
-    bytesUpdated += sizeof(glm::vec3);
-    gl9BindBuffer( GL_ARRAY_BUFFER, 0 );
-#else
-    // async update
-    const uint16_t chickletMask = (1 << ChickletBitSize) -1;
-    triUpdateSet.insert( tri.x & ~chickletMask );
-    triUpdateSet.insert( tri.y & ~chickletMask );
-    triUpdateSet.insert( tri.z & ~chickletMask );
-#endif
+        Interleave( tri.z );
+        UpdateItem( vertStream, interVerts, tri.z );
+    }
+    else
+    {
+#if !defined(OGL1) // OGL1 tri color set from 3rd vert only
+        UpdateItem( colorStream, colorVerts, tri.x );
+        UpdateItem( colorStream, colorVerts, tri.y );
+#endif // OGL1
+        UpdateItem( colorStream, colorVerts, tri.z );
+    }
 }
 void RSphere::UpdateColorTick()
 {
-    if(triUpdateSet.size() == 0) return;
-
-    gl9BindBuffer( GL_ARRAY_BUFFER, boColor );
-
-#if (SUBDATA_UPDATE_MODE == 0)
-    assert( false ); // already updated
-#elif (SUBDATA_UPDATE_MODE == 1)
-    auto s = *triUpdateSet.begin();
-    auto e = *triUpdateSet.rbegin();
-    gl9BufferSubData( GL_ARRAY_BUFFER, sizeof(glm::vec3) * s, sizeof(glm::vec3) * (e -s +1), &colorVerts[s] );
-    bytesUpdated += sizeof(glm::vec3) * (e -s +1);
-#elif (SUBDATA_UPDATE_MODE == 2)
-    BufferSubData_Chicklet( GL_ARRAY_BUFFER, colorVerts, triUpdateSet, ChickletBitSize );
-#endif
-
-    gl9BindBuffer( GL_ARRAY_BUFFER, 0 );
-
-    triUpdateSet.clear();
+    if(storage == InterleavedStorage)
+        vertStream.Tick( interVerts.data() );
+    else
+        colorStream.Tick( colorVerts );
 }
 void RSphere::UpdateColorFinalize()
 {
@@ -476,15 +741,33 @@ void RSphere::UpdateColorFinalize()
 
 void RSphere::UpdateAllStates()
 {
-    gl9BindBuffer( GL_ARRAY_BUFFER, boPos );
-    gl9BufferSubData( GL_ARRAY_BUFFER, 0, posVerts.size() * sizeof( glm::vec3 ), posVerts.data() );
-    gl9BindBuffer( GL_ARRAY_BUFFER, boColor );
-    gl9BufferSubData( GL_ARRAY_BUFFER, 0, colorVerts.size() * sizeof( glm::vec3 ), colorVerts.data() );
-    gl9BindBuffer( GL_ARRAY_BUFFER, 0 );
+    if(storage == InterleavedStorage)
+    {
+        for(vertID_type v = 0; v < posVerts.size(); v++) Interleave(v);
+        vertStream.MarkAll();
+        vertStream.Tick( interVerts.data() );
+        return;
+    }
+
+    posStream.MarkAll();
+    posStream.Tick( posVerts );
+    normStream.MarkAll();
+    normStream.Tick( normVerts );
+    colorStream.MarkAll();
+    colorStream.Tick( colorVerts );
 }
 
-void RSphere::SaveSTL(const char* szFilename)
+RSphere::snapshot_type RSphere::Snapshot()
 {
+    if( !snapshotTris ) snapshotTris = std::make_shared<const std::vector<ind3_type>>( indTriVerts );
+    return { posVerts, normVerts, colorVerts, snapshotTris };
+}
+
+void RSphere::SaveSTL(const char* szFilename, const snapshot_type& snap)
+{
+    const auto& indTriVerts = *snap.indTriVerts;
+    const auto& posVerts = snap.posVerts;
+
     std::string f = std::string(szFilename) + ".stl";
     AppFile file(f.c_str(), AppFile::Library, AppFile::WriteMode);
     if( file.pFile )
@@ -499,7 +782,8 @@ void RSphere::SaveSTL(const char* szFilename)
 
         for( uint i=0; i<indTriVerts.size(); i++ )
         {
-            fwrite( &normTris[ i ], sizeof(float), 3, file.pFile );
+            const auto normTri = glm::triangleNormal( posVerts[ indTriVerts[ i ].x ], posVerts[ indTriVerts[ i ].y ], posVerts[ indTriVerts[ i ].z ] );
+            fwrite( &normTri, sizeof(float), 3, file.pFile );
             fwrite( &posVerts[ indTriVerts[ i ].x ], sizeof(float), 3, file.pFile );
             fwrite( &posVerts[ indTriVerts[ i ].y ], sizeof(float), 3, file.pFile );
             fwrite( &posVerts[ indTriVerts[ i ].z ], sizeof(float), 3, file.pFile );
@@ -510,8 +794,13 @@ void RSphere::SaveSTL(const char* szFilename)
     }
 }
 
-void RSphere::SavePLY(const char *szFilename)
+void RSphere::SavePLY(const char *szFilename, const snapshot_type& snap)
 {
+    const auto& indTriVerts = *snap.indTriVerts;
+    const auto& posVerts = snap.posVerts;
+    const auto& normVerts = snap.normVerts;
+    const auto& colorVerts = snap.colorVerts;
+
     std::string f = std::string(szFilename) + ".ply";
     AppFile file(f.c_str(), AppFile::Library, AppFile::WriteMode);
     if( file.pFile )
@@ -542,7 +831,7 @@ void RSphere::SavePLY(const char *szFilename)
             auto c = colorVerts[i];
             file.Printf( "%f %f %f %f %f %f %d %d %d\n", v.x, v.y, v.z, n.x, n.y, n.z, int(255 * c.x), int(255 * c.y), int(255 * c.z) );
         }
-        for( auto i : indTriVerts ) file.Printf( "3 %d %d %d\n", i.x, i.y, i.z );
+        for( auto i : indTriVerts ) file.Printf( "3 %u %u %u\n", uint(i.x), uint(i.y), uint(i.z) );
     }
 }
 
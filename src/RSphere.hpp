@@ -8,54 +8,108 @@
 #include <map>
 #include <functional>
 #include <set>
+#include <memory>
 
 #include "AppTypes.hpp"
 #include "CRubus.hpp"
+#include "CBvh.hpp"
+#include "CIdBuffer.hpp"
+#include "AppUploader.hpp"
+#include "AppJournal.hpp"
 
 struct RSphere: public IDefineTri, public IRenormalizable
 {
-    std::vector<glm::vec3> posVerts;
-    std::vector<glm::vec3> posVerts_backup;
+    // separate buffers per attribute, or one buffer of interleaved verts
+    enum storage_type { SeparateStorage, InterleavedStorage };
+    storage_type storage = SeparateStorage; // takes effect on next Bind
+
+    struct vertex_type
+    {
+        glm::vec3 pos;
+        glm::vec3 norm;
+        glm::vec3 color;
+    };
+
+    // paged copy-on-write, so Snapshot() is cheap. write with Write()
+    vertarray_type posVerts;
     std::vector<ind3_type> indTriVerts;
     std::vector<ind3_type> indTriAdjTris;
-    std::vector<glm::vec3> normTris, normVerts;
+    vertTris_type vertTris;
+    std::vector<glm::vec3> normTris;
+    vertarray_type normVerts;
 
     std::vector<float> normEffectVerts;
 
-    std::vector<glm::vec3> colorVerts;
-    std::vector<glm::vec3> colorVerts_backup;
-    std::set<triID_type> triUpdateSet;
+    vertarray_type colorVerts;
+    std::vector<vertex_type> interVerts; // staged for upload in InterleavedStorage
 
-    template<class T>
-    void BufferSubData_Chicklet(
-        const GLenum& target,
-        const std::vector<T>& vec,
-        const std::set<uint16_t>& markings,
-        const uint16_t& chickletBitSize
-    );
+    // async or instant update, per uploadSettings.strategy
+    template<class A>
+    void UpdateItem(AppUploadStream& stream, const A& vec, const vertID_type& i);
 
-    GLuint boPos = 0;
-    GLuint boIndicies = 0;
-    GLuint boNormals = 0;
-    GLuint boColor = 0;
+    void Interleave(vertID_type v) { interVerts[ v ] = { posVerts[ v ], normVerts[ v ], colorVerts[ v ] }; }
+
+    AppJournal journal; // per-stroke undo history
+
+    using replay_type = bool (AppJournal::*)(AppJournal::arrays_type, AppJournal::touch_type);
+    bool Replay(replay_type fnReplay);
 
-    uint bytesUpdated = 0;
+    // verts moved since the last finalize. the tris around them are the only ones to refit
+    dirtybits_type movedVerts, movedTris, renormVerts;
+    void Moved(vertID_type v);
+    void FinalizeMoved();
+
+    // where a vert was when this stroke began
+    const glm::vec3& StrokeStartPos(vertID_type v) const
+    {
+        auto p = journal.Original( AppJournal::PosChannel, v );
+        return p ? *p : posVerts[ v ];
+    }
+
+    AppUploadSettings uploadSettings;
+    bool uploadCalibrated = false; // keeps uploadSettings across Binds
+    AppUploadStats uploadStats;
+    AppUploadStream posStream, normStream, colorStream;
+    AppUploadStream vertStream; // InterleavedStorage
+    GLuint boIndicies = 0;
+    GLenum indTypeID = ind3_type::base_typeid; // may be narrower than ind3_type when packed
 
     static bool CheatSphereOnly;
+    static uint divisionSize;
+    static bool wideIndicies; // whether the driver draws 32 bit indicies, found at Bind(). limits the divisions when not
 
     uint GetDivisions() const;
+    static uint SetDivisions(uint divisions); // clamped, takes effect on next Reset
 
     RSphere() = default;
     virtual ~RSphere() = default;
 
-    void Reset(bool fromBackup = false);
-    void Backup();
-    void SavePLY(const char *szFilename);
-    void SaveSTL(const char* szFilename);
+    // a frozen view of the model for readers that outlive a frame, eg exporters.
+    // shares pages with the model until the model writes them
+    struct snapshot_type
+    {
+        vertarray_type posVerts, normVerts, colorVerts;
+        std::shared_ptr<const std::vector<ind3_type>> indTriVerts;
+    };
+    std::shared_ptr<const std::vector<ind3_type>> snapshotTris; // copied on first Snapshot after a Reset
+    snapshot_type Snapshot();
+
+    static void SavePLY(const char *szFilename, const snapshot_type& snap);
+    static void SaveSTL(const char* szFilename, const snapshot_type& snap);
+
+    void Reset();
+    void StrokeBegin();
+    void StrokeCommit();
+    bool Undo(); // false when there's no history
+    bool Redo();
 
     void Bind();
     void Release();
+    void BindStreams();
+    void ReleaseStreams();
+    void CalibrateUploads(); // rebinds the streams with the fastest uploadSettings
     void Render();
+    void RenderInterleaved();
     void RenderCollisionBody(glm::vec3 axisIn, glm::vec3 axisUp, glm::vec3 color);
     void RenderNormals();
 
@@ -65,6 +119,7 @@ struct RSphere: public IDefineTri, public IRenormalizable
     void UpdatePosFinalize();
 
     void BrushZ(triID_type triID, float const &k);
+    void UpdateNormalTick();
     void UpdateNormalFinalize();
 
     void BrushColor(triID_type triID, glm::vec3 const & color, float const blend = 1.f); // .5f is full blend
@@ -73,6 +128,13 @@ struct RSphere: public IDefineTri, public IRenormalizable
     void UpdateColorFinalize();
 
     void UpdateAllStates();
+    // dirty chicklets for the next ticks of the streams with these attributes
+    enum upload_type { PosUpload = 1, NormalUpload = 2, ColorUpload = 4 };
+    size_t UploadBacklog(uint uploads) const;
+
+#ifdef DEBUG
+    static bool Test(); // headless, whether the ticks of a steady stroke don't allocate, at several divisions. see RSphereTest.cpp
+#endif // DEBUG
 
     // IDefineTri
     void TriPosNorm(glm::vec3 &position, glm::vec3 &normal, triID_type const &triID) final
@@ -98,21 +160,36 @@ struct RSphere: public IDefineTri, public IRenormalizable
     uint TriInd(triID_type triID) final { return triID; }
     ind3_type TriVertInd(triID_type triID) final { return indTriVerts[ triID ]; }
     IDefineTri* GetIDefineTri() final { return this; }
-    ind3_type AdjTriInd(triID_type t) final
-    {
-        auto offset = triID_type(GetDivisions());
-        if(t == 0) return { 1, TriIDEnd, TriIDEnd }; // end
-        else if(t == normTris.size() -1) return { triID_type(normTris.size()-2), TriIDEnd, TriIDEnd }; // end
-        else if(offset < t && t < normTris.size() -1 -offset) return { triID_type(t-1), triID_type(t+1), triID_type(t+offset) }; // middle
-        else return { triID_type(t-1), triID_type(t+1), TriIDEnd }; // near an end
-    }
+    ind3_type AdjTriInd(triID_type t) final { return indTriAdjTris[ t ]; }
     bool HasDegenerates() final { return false; }
     std::vector<glm::vec3>& GetNormTris() final { return normTris; }
-    std::vector<glm::vec3>& GetNormVerts() final { return normVerts; }
-    std::vector<glm::vec3>& GetPosVerts() final { return posVerts; }
+    vertarray_type& GetNormVerts() final { return normVerts; }
+    vertarray_type& GetPosVerts() final { return posVerts; }
+    const vertTris_type& GetVertTris() final { return vertTris; }
+    void UpdateNorm(vertID_type v) final;
+    void UpdateAllNorms() final;
+
+    // which collision body picks tris. only that one is bound and kept up to date
+    enum picking_type { RubusPicking, BvhPicking, BufferPicking };
+    picking_type picking = RubusPicking;
+    void SetPicking(picking_type p); // rebinds
+    IIdentifyTri& Picker()
+    {
+        if( picking == BvhPicking ) return bvh;
+        if( picking == BufferPicking ) return idBuffer;
+        return rubus;
+    }
+    void ResetPicker()
+    {
+        if( picking == BvhPicking ) bvh.Reset();
+        else if( picking == BufferPicking ) idBuffer.Reset();
+        else rubus.Reset();
+    }
 
     //private:
-    CRubus rubus; // collision body
+    CRubus<RSphere> rubus; // collision body
+    CBvh bvh;
+    CIdBuffer idBuffer; // needs SetView() from the app
 
 };
 
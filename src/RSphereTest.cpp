@@ -0,0 +1,150 @@
+// Copyright 2025 orthopteroid@gmail.com, MIT License
+
+// headless DEBUG test of steady strokes, built without a platform or gl backend
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "GL9.hpp"
+#include "AppLog.hpp"
+#include "AppFile.hpp"
+#include "AppAllocCounter.hpp"
+#include "AppTriBrusher.hpp"
+#include "AppNormalBrusher.hpp"
+#include "RSphere.hpp"
+
+#define __FILENAME__ (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
+
+inline float glLength(const glm::vec3& vec) { return sqrt( glm::dot(vec, vec) ); }
+
+// the model is stroked without gl streams or files, so nothing here is ever reached
+void gl9BindBuffer (GLenum target, GLuint buffer) { abort(); }
+void gl9BufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) { abort(); }
+void gl9BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) { abort(); }
+void gl9Circle(glm::vec3 const & axisIn, glm::vec3 const & axisUp, glm::vec3 const & posCenter, float radius, uint steps) { abort(); }
+void gl9ColorPointer( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr ) { abort(); }
+void gl9Color3fv(const GLfloat *f) { abort(); }
+void gl9DeleteBuffers(GLsizei n, const GLuint *buffers) { abort(); }
+void gl9DisableClientState( GLenum cap ) { abort(); }
+void gl9DrawElements( GLenum mode, GLsizei count, GLenum type, const GLvoid *indices ) { abort(); }
+void gl9EnableClientState( GLenum cap ) { abort(); }
+void gl9Finish( void ) { abort(); }
+void gl9GenBuffers(GLsizei n, GLuint *buffers) { abort(); }
+void gl9MatrixMode( GLenum mode ) { abort(); }
+void gl9Normal( const glm::vec3 & v0, const glm::vec3 & v1, const glm::vec3 & v2, glm::vec3 const & norm, float k) { abort(); }
+void gl9PopAttrib() { abort(); }
+void gl9PopMatrix( void ) { abort(); }
+void gl9PushAttrib( GLbitfield mask ) { abort(); }
+void gl9PushMatrix( void ) { abort(); }
+void gl9VertexPointer( GLint size, GLenum type, GLsizei stride, const GLvoid *ptr ) { abort(); }
+bool gl9WideIndicies() { abort(); }
+
+AppFile::AppFile(const char* szFilename, file_type ft, file_mode fm) { abort(); }
+AppFile::~AppFile() {}
+void AppFile::Printf(const char* format, ...) { abort(); }
+
+// swells tris by how near their centers are to the hit tri's, and tints them, for Test()
+struct TestSwellTool
+{
+    RSphere& model;
+    AppTriBrusher& brusher;
+    AppNormalBrusher<RSphere>& normalBrusher;
+    float sign;
+
+    void Effects(const triID_type* tris, uint n, float* effects_out)
+    {
+        glm::vec3 posHit, normHit, pos, norm;
+        model.TriPosNorm( posHit, normHit, brusher.searchCxt.collisionTri );
+        for( uint i = 0; i < n; i++ )
+        {
+            model.TriPosNorm( pos, norm, tris[ i ] );
+            effects_out[ i ] = 1.f - glLength( pos - posHit ) / brusher.patchSize;
+        }
+    }
+    void Paint(triID_type triID, float patchEffect, float handleEffect)
+    {
+        model.BrushPos( triID, sign * model.normTris[ triID ], .01f * patchEffect );
+        model.BrushColor( triID, glm::vec3( .5f ), patchEffect );
+        normalBrusher.Continue( triID );
+    }
+};
+
+// strokes a model with no gl streams back and forth, inflating then deflating, counting the heap
+// allocations of each tick. the first strokes grow the scratch, and after that ticks mustn't allocate
+static bool TestStrokeAllocs(uint divisions)
+{
+    const uint kStrokes = 4, kWarmStrokes = 2, kTicks = 60;
+
+    const glm::vec4 viewport( 0, 0, 640, 480 );
+    const glm::vec3 eye( 0, 0, 3 );
+    const glm::mat4 view = glm::lookAt( eye, glm::vec3( 0 ), glm::vec3( 0, 1, 0 ) );
+    const glm::mat4 proj = glm::perspective( glm::radians( 45.f ), viewport.z / viewport.w, .1f, 10.f );
+    auto fnProject = [&] (glm::vec3 p) { return glm::project( p, view, proj, viewport ); };
+    auto fnUnproject = [&] (glm::vec3 p) { return glm::unProject( glm::vec3( p.x, viewport.w - p.y, p.z ), view, proj, viewport ); };
+
+    RSphere model;
+    model.Reset();
+    model.rubus.Bind( &model );
+    AppNormalBrusher<RSphere> normalBrusher;
+    normalBrusher.Bind( &model );
+    AppTriBrusher brusher;
+    brusher.Bind( &model.rubus, &model );
+
+    size_t steadyAllocs = 0, steadyTicks = 0;
+    for( uint stroke = 0; stroke < kStrokes; stroke++ )
+    {
+        TestSwellTool tool = { model, brusher, normalBrusher, stroke & 1 ? -1.f : +1.f };
+        glm::vec3 touch( 200, 240, 0 );
+
+        model.StrokeBegin();
+        normalBrusher.Start();
+        brusher.Start( touch, eye, fnProject, fnUnproject, tool, .2f );
+        for( uint tick = 0; tick < kTicks; tick++ )
+        {
+            const size_t allocs = AppAllocCounter::Allocations();
+
+            touch.x += 4.f;
+            brusher.Continue( touch );
+            brusher.Stroke( tool, 200 );
+            normalBrusher.Stroke( 200 );
+            model.UpdatePosTick();
+            model.UpdateNormalTick();
+            model.UpdateColorTick();
+
+            trisearch_type cxt;
+            model.rubus.IdentifyTri( cxt, eye, glm::normalize( fnUnproject( touch ) - eye ) );
+
+            if( stroke < kWarmStrokes ) continue;
+            steadyAllocs += AppAllocCounter::Allocations() - allocs;
+            steadyTicks++;
+        }
+        brusher.Stop();
+        normalBrusher.Stop();
+        model.StrokeCommit();
+        model.UpdatePosFinalize();
+        model.UpdateNormalFinalize();
+    }
+
+    AppLog::Info( __FILENAME__, "%s: %u divisions, %.2f allocations per steady tick", __func__, divisions, float( steadyAllocs ) / float( steadyTicks ) );
+    return steadyAllocs == 0;
+}
+
+// at several sizes, as rows and packets only outgrow their scratch on the larger meshes
+bool RSphere::Test()
+{
+    const uint divisions = divisionSize;
+    const uint kDivisions[] = { divisions, 100, 300, 600 };
+
+    bool passed = true;
+    for( uint d : kDivisions ) passed &= TestStrokeAllocs( SetDivisions( d ) );
+    divisionSize = divisions;
+    return passed;
+}
+
+int main()
+{
+    return RSphere::Test() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
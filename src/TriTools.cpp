@@ -1,8 +1,11 @@
 // Copyright 2025 orthopteroid@gmail.com, MIT License
 
 #include <iostream>
+#include <cassert>
 #include <math.h>
 #include <cmath>
+#include <algorithm>
+#include <limits>
 
 #include "GL9.hpp"
 
@@ -92,6 +95,63 @@ binID_type BinMake(glm::vec3 const & pos, uint8_t dim)
     return bin;
 }
 
+// polynomial fit of atan(a) * 4 / pi on [-1,1]. warps a face's tangent-plane coords, which bunch
+// up towards the face center, to about equal angles, so bins have roughly equal areas
+inline float CubeWarp(float a)
+{
+    const float b = std::abs(a);
+    return a - a * (b - 1.f) * (0.3116f + 0.0844f * b);
+}
+
+binID_type CubeBinMake(glm::vec3 const & pos, uint8_t dim)
+{
+    // the face is the major axis and its sign, u and v are the next two axes
+    const glm::vec3 a = glm::abs(pos);
+    const bool xMajor = a.x >= a.y && a.x >= a.z, yMajor = !xMajor && a.y >= a.z;
+    const float major = xMajor ? pos.x : ( yMajor ? pos.y : pos.z );
+    const float cu = xMajor ? pos.y : ( yMajor ? pos.z : pos.x );
+    const float cv = xMajor ? pos.z : ( yMajor ? pos.x : pos.y );
+    const uint face = ( xMajor ? 0u : ( yMajor ? 2u : 4u ) ) + ( major < 0.f ? 1u : 0u );
+    const float scale = major != 0.f ? 1.f / std::abs(major) : 0.f;
+    const float half = .5f * float(dim);
+
+    const int top = int(dim) - 1;
+    const int u = std::max( 0, std::min( top, int( ( CubeWarp( cu * scale ) + 1.f ) * half ) ) );
+    const int v = std::max( 0, std::min( top, int( ( CubeWarp( cv * scale ) + 1.f ) * half ) ) );
+    return binID_type( ( face * dim + uint(v) ) * dim + uint(u) );
+}
+
+binID_type CubeBinAdjust(binID_type bin, int du, int dv, uint8_t dim)
+{
+    const int n = dim;
+    if( bin >= 6 * n * n ) return BinIDEnd;
+
+    // the cell's center on a cube of half-width n. as n is even, the face's coord is the only even one
+    const int face = bin / (n * n), axis = face / 2;
+    int p[3];
+    p[ axis ] = face & 1 ? -n : n;
+    p[ (axis + 1) % 3 ] = 2 * ( bin % n + du ) + 1 - n;
+    p[ (axis + 2) % 3 ] = 2 * ( (bin / n) % n + dv ) + 1 - n;
+
+    auto fnSign = [] (int c) { return c < 0 ? -1 : 1; };
+    auto fnFace = [&] () { return std::abs( p[0] ) == n ? 0 : ( std::abs( p[1] ) == n ? 1 : 2 ); };
+
+    // fold what ran off the face over the edge, moving the face's coord in by as much.
+    // near a corner both can run off, and then the second fold is onto the third face
+    for( int k = 0; k < 3; k++ )
+    {
+        const int over = std::min( std::abs( p[k] ) - n, 2 * n - 1 ); // no further than the next face's far edge
+        if( over <= 0 ) continue;
+        const int f = fnFace();
+        p[ f ] = fnSign( p[ f ] ) * ( n - over );
+        p[ k ] = fnSign( p[ k ] ) * n;
+    }
+
+    const int f = fnFace();
+    const int u = ( p[ (f + 1) % 3 ] + n - 1 ) / 2, v = ( p[ (f + 2) % 3 ] + n - 1 ) / 2;
+    return binID_type( ( ( f * 2 + ( p[ f ] < 0 ? 1 : 0 ) ) * n + v ) * n + u );
+}
+
 void TriVertNormals(
         std::vector<glm::vec3>& normVerts,
         std::vector<glm::vec3>& normTris,
@@ -99,126 +159,177 @@ void TriVertNormals(
         const std::vector<glm::vec3>& posVerts
 )
 {
+    AppJobs& jobs = AppJobs::Pool();
+
     // calc normals for triangles and verticies
-    for(uint i=0; i<indTriVerts.size(); i++)
-    {
-        uint p0=indTriVerts[i].x, p1=indTriVerts[i].y, p2=indTriVerts[i].z;
-        glm::vec3 norm = glm::triangleNormal( posVerts[ p0 ], posVerts[ p1 ], posVerts[ p2 ] );
-        normVerts[ p0 ] += norm; // borked
-        normVerts[ p1 ] += norm;
-        normVerts[ p2 ] += norm;
-        normTris[i] = norm;
-    }
-    for(uint i=0; i<normVerts.size(); i++ )
-    {
-        const glm::vec3 third( 1.f / 3.f );
-        normVerts[i] *= third; // normalize
-    }
+    jobs.ParallelFor( 0, indTriVerts.size(), 4096, [&] (size_t first, size_t end) {
+        for(size_t i=first; i<end; i++)
+        {
+            uint p0=indTriVerts[i].x, p1=indTriVerts[i].y, p2=indTriVerts[i].z;
+            normTris[i] = glm::triangleNormal( posVerts[ p0 ], posVerts[ p1 ], posVerts[ p2 ] );
+        }
+    } );
+
+    TriVertSums( normVerts.size(), indTriVerts.size(),
+        [&] (triID_type t) { return indTriVerts[ t ]; },
+        [&] (triID_type t) { return normTris[ t ]; },
+        [&] (vertID_type v, const glm::vec3& sum, uint) {
+            normVerts[ v ] = VertNormal( normVerts[ v ] + sum );
+        } );
 }
 
 // build adjacent-tri list
 void IndTriAdjTris(std::vector<ind3_type>& indTriAdjTris, const std::vector<ind3_type>& indTriVerts)
 {
+    // verts packed as tightly as the mesh allows, low vertID in the high half
+    vertID_type maxVert = 0;
+    for (auto& tri : indTriVerts) maxVert = std::max( maxVert, std::max( tri.x, std::max( tri.y, tri.z ) ) );
+    unsigned vertBits = 1;
+    while( vertBits < 8 * sizeof(vertID_type) && ( vertID_vertID_key(maxVert) >> vertBits ) ) vertBits++;
+
     struct edge_type
     {
-        union
-        {
-            uint32_t key; // assumes vertID_type is uint16_t
-            struct
-            {
-                vertID_type a;
-                vertID_type b;
-            } id;
-        };
-        edge_type(vertID_type a_, vertID_type b_)
+        vertID_vertID_key key;
+        triID_type tri;
+    };
+    auto fnEdge = [vertBits] (vertID_type a_, vertID_type b_, triID_type t) -> edge_type {
+        if(a_<b_) return { vertID_vertID_key(a_) << vertBits | b_, t };
+        else return { vertID_vertID_key(b_) << vertBits | a_, t };
+    };
+
+    AppJobs& jobs = AppJobs::Pool();
+
+    // in tri order, which the stable sort keeps for tris sharing an edge
+    std::vector<edge_type> edges( indTriVerts.size() * 3 );
+    jobs.ParallelFor( 0, indTriVerts.size(), 4096, [&] (size_t first, size_t end) {
+        for (size_t t = first; t < end; t++)
         {
-            if(a_<b_) { id.a = a_; id.b = b_; } else { id.a = b_; id.b = a_; }
+            edges[ t * 3 + 0 ] = fnEdge(indTriVerts[t].x, indTriVerts[t].y, triID_type(t));
+            edges[ t * 3 + 1 ] = fnEdge(indTriVerts[t].x, indTriVerts[t].z, triID_type(t));
+            edges[ t * 3 + 2 ] = fnEdge(indTriVerts[t].z, indTriVerts[t].y, triID_type(t));
         }
-        bool operator<(const edge_type& other) const { return this->key < other.key; }
-    };
+    } );
+    jobs.ParallelRadixSort( edges, [] (const edge_type& e) { return e.key; }, 2 * vertBits );
 
-    std::multimap<edge_type, triID_type> etmap;
-    for (triID_type t = 0; t < indTriVerts.size(); t++)
+    // two tris per edge, into the next free slot of each
+    indTriAdjTris.assign( indTriVerts.size(), ind3_type( TriIDEnd, TriIDEnd, TriIDEnd ) );
+    auto fnAdd = [&indTriAdjTris] (triID_type t, triID_type other) {
+        ind3_type& adj = indTriAdjTris[t];
+        if( adj.x == TriIDEnd ) adj.x = other;
+        else if( adj.y == TriIDEnd ) adj.y = other;
+        else if( adj.z == TriIDEnd ) adj.z = other;
+        else assert(false); // 3 neighbours at most
+    };
+    for( size_t i = 0; i + 1 < edges.size(); i++ )
     {
-        etmap.insert(std::make_pair(edge_type(indTriVerts[t].x, indTriVerts[t].y), t));
-        etmap.insert(std::make_pair(edge_type(indTriVerts[t].x, indTriVerts[t].z), t));
-        etmap.insert(std::make_pair(edge_type(indTriVerts[t].z, indTriVerts[t].y), t));
+        if( edges[i].key != edges[i + 1].key ) continue;
+        fnAdd( edges[i].tri, edges[i + 1].tri );
+        fnAdd( edges[i + 1].tri, edges[i].tri );
+        i++;
+
+        // except at ends!
+        //assert(edges[i + 1].key != edges[i].key); // 3 tris can't share an edge
     }
-    std::multimap<triID_type, triID_type> ttmap; // two tris per edge
-    auto edgeIter=etmap.begin();
-    while( edgeIter!=etmap.end() )
+}
+
+// tris ascending for each vert, a counting sort
+void IndVertTris(vertTris_type& vertTris, size_t nVerts, const std::vector<ind3_type>& indTriVerts)
+{
+    vertTris.offsets.assign( nVerts + 1, 0 );
+    for (auto& tri : indTriVerts)
     {
-        auto e = edgeIter->first;
-        auto t0 = edgeIter->second;
-        edgeIter++;
-        if(edgeIter == etmap.end()) continue;
-        if(edgeIter->first.key == e.key)
-        {
-            auto t1 = edgeIter->second;
-            ttmap.insert(std::make_pair(t0, t1));
-            ttmap.insert(std::make_pair(t1, t0));
-            edgeIter++;
-            if(edgeIter == etmap.end()) continue;
-
-            // except at ends!
-            //assert(edgeIter->first != e); // 3 tris can't share an edge
-        }
+        vertTris.offsets[ tri.x + 1 ]++;
+        vertTris.offsets[ tri.y + 1 ]++;
+        vertTris.offsets[ tri.z + 1 ]++;
     }
-    // compress the ttmap
-    indTriAdjTris.resize( indTriVerts.size() );
+    for (size_t v = 0; v < nVerts; v++) vertTris.offsets[ v + 1 ] += vertTris.offsets[ v ];
+
+    std::vector<size_t> next( vertTris.offsets.begin(), vertTris.offsets.end() - 1 );
+    vertTris.items.resize( indTriVerts.size() * 3 );
     for (triID_type t = 0; t < indTriVerts.size(); t++)
     {
-        int i=0;
-        indTriAdjTris[t] = {TriIDEnd, TriIDEnd, TriIDEnd};
-        for (auto iterTT = ttmap.lower_bound(t); iterTT != ttmap.upper_bound(t); iterTT++)
-        {
-            assert(i<3);
-            switch(i++)
-            {
-                case 0: indTriAdjTris[t].x = iterTT->second; break;
-                case 1: indTriAdjTris[t].y = iterTT->second; break;
-                case 2: indTriAdjTris[t].z = iterTT->second; break;
-                default: ;
-            }
-        }
+        vertTris.items[ next[ indTriVerts[t].x ]++ ] = t;
+        vertTris.items[ next[ indTriVerts[t].y ]++ ] = t;
+        vertTris.items[ next[ indTriVerts[t].z ]++ ] = t;
     }
 }
 
-void AdjTriVisitor(
-    std::deque<trieffect_type>& deq_out,
+bool TriWalk(
+    trisearch_type& cxt_out,
     triID_type triStart,
-    const std::vector<ind3_type>& indTriAdjTris,
-    const serial_type serial,
-    std::vector<serial_type>& serialMarkings,
-    EffectorFn& fnTriEffector
+    IDefineTri& triangular,
+    glm::vec3 const & position,
+    glm::vec3 const & directionFrom,
+    glm::vec3 const & direction,
+    uint steps,
+    std::vector<triID_type>* pPath_out
 )
 {
-    std::deque<triID_type> triWorkingSet;
+    const glm::vec3 sweep = glm::cross( directionFrom, direction ); // normal of the plane the rays sweep
 
-    triWorkingSet.push_back( triStart );
-    while( !triWorkingSet.empty() )
+    const std::vector<ind3_type>& indTris = triangular.GetIndTris();
+    const std::vector<ind3_type>& indTriAdjTris = triangular.GetIndTriAdjTris();
+
+    triID_type triID = triStart, triPrev = TriIDEnd;
+    for( uint step = 0; step <= steps && triID != TriIDEnd; step++ )
     {
-        auto fnQueueForCheck = [&](triID_type tID)
+        glm::vec3 v0, v1, v2;
+        triangular.GetTriVerts(v0, v1, v2, triID);
+
+        // requires glm-0.9.7.6. the same test the pickers use, so a walk finds what they would
+        glm::vec3 baryPosition;
+        if( glm::intersectRayTriangle<glm::vec3>( position, direction, v0, v1, v2, baryPosition ) )
         {
-            if(tID == TriIDEnd) return;
-            if(serialMarkings[ tID ] != serial)
+            cxt_out.collisionTri = triID;
+            cxt_out.collisionBary = glm::vec2( baryPosition );
+            cxt_out.collisionDist = baryPosition.z;
+            return true;
+        }
+        if( pPath_out && step > 0 ) pPath_out->push_back( triID );
+
+        // where the ray crosses the plane, as glm has it
+        const glm::vec3 e1 = v1 - v0, e2 = v2 - v0;
+        const glm::vec3 p = glm::cross( direction, e2 );
+        const float a = glm::dot( e1, p );
+        if( !( a >= std::numeric_limits<float>::epsilon() ) ) return false; // faces away, or edge-on
+        const float f = 1.f / a;
+        const glm::vec3 s = position - v0, q = glm::cross( s, e1 );
+        const float u = f * glm::dot( s, p ), v = f * glm::dot( direction, q );
+        if( f * glm::dot( e2, q ) < 0.f ) return false; // behind the eye
+
+        // out over an edge the crossing is beyond, and of those one the sweep from directionFrom
+        // crosses that isn't the way in, else the one opposite the most negative weight
+        const ind3_type& tri = indTris[ triID ];
+        const ind3_type& adj = indTriAdjTris[ triID ];
+        const vertID_type ids[3] = { tri.x, tri.y, tri.z };
+        const float weights[3] = { 1.f - u - v, u, v };
+        const float sides[3] = { glm::dot( sweep, v0 - position ), glm::dot( sweep, v1 - position ), glm::dot( sweep, v2 - position ) };
+
+        auto fnAcross = [&] (int k) {
+            const vertID_type a0 = ids[ ( k + 1 ) % 3 ], a1 = ids[ ( k + 2 ) % 3 ];
+            for( triID_type t : { adj.x, adj.y, adj.z } )
             {
-                serialMarkings[ tID ] = serial;
-                triWorkingSet.push_back( tID );
+                if( t == TriIDEnd ) continue;
+                const ind3_type& other = indTris[ t ];
+                if( ( other.x == a0 || other.y == a0 || other.z == a0 ) && ( other.x == a1 || other.y == a1 || other.z == a1 ) ) return t;
             }
+            return TriIDEnd;
         };
 
-        auto triID = triWorkingSet.front();
-        triWorkingSet.pop_front();
-
-        auto calc = fnTriEffector( triID );
-        if( calc.first )
+        int exit = 0;
+        for( int k = 1; k < 3; k++ ) if( weights[ k ] < weights[ exit ] ) exit = k;
+        int swept = -1;
+        for( int k = 0; k < 3; k++ )
         {
-            deq_out.push_back( { triID, calc.second } );
-
-            fnQueueForCheck( indTriAdjTris[ triID ].x );
-            fnQueueForCheck( indTriAdjTris[ triID ].y );
-            fnQueueForCheck( indTriAdjTris[ triID ].z );
+            if( !( weights[ k ] < 0.f ) ) continue;
+            if( sides[ ( k + 1 ) % 3 ] * sides[ ( k + 2 ) % 3 ] > 0.f ) continue;
+            if( fnAcross( k ) == triPrev ) continue;
+            if( swept < 0 || weights[ k ] < weights[ swept ] ) swept = k;
         }
+        if( swept >= 0 ) exit = swept;
+
+        triPrev = triID;
+        triID = fnAcross( exit );
     }
+    return false;
 }
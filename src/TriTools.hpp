@@ -12,6 +12,7 @@
 #include <glm/vec3.hpp>
 
 #include "AppTypes.hpp"
+#include "AppJobs.hpp"
 
 binID_type BinMake(glm::vec3 const & pos, uint8_t dim);
 
@@ -32,6 +33,75 @@ inline uint BinLinearDist(uint8_t a, uint8_t b, uint8_t dim)
     return d;
 }
 
+// Six-face cube map bins, (face * dim + v) * dim + u for a dim x dim grid on each face.
+// dim must be even and no more than 104 so that the ids fit below BinIDEnd.
+binID_type CubeBinMake(glm::vec3 const & pos, uint8_t dim);
+
+// steps du,dv cells across the face, folding over an edge onto the next face. BinIDEnd stays put
+binID_type CubeBinAdjust(binID_type bin, int du, int dv, uint8_t dim);
+
+// unit length, or zero for a vert whose tri normals cancel or that has only degenerate tris
+inline glm::vec3 VertNormal(const glm::vec3& sum)
+{
+    const float len = glm::length( sum );
+    return len > 0.f ? sum / len : glm::vec3( 0.f );
+}
+
+// Sums a per-tri value onto each of the tri's verts, in parallel chunks of tris.
+// Each chunk sums into its own span of verts and the spans are reduced in chunk order,
+// so results don't depend on the thread count. Then fnVert(v, sum, tris) for every vert.
+template<class TriVertsFn, class TriValueFn, class VertFn>
+void TriVertSums(size_t nVerts, size_t nTris, TriVertsFn fnTriVerts, TriValueFn fnTriValue, VertFn fnVert)
+{
+    const size_t grain = 4096;
+    AppJobs& jobs = AppJobs::Pool();
+
+    struct partial_type
+    {
+        size_t first = 0, end = 0; // verts
+        std::vector<glm::vec3> sums;
+        std::vector<uint16_t> tris;
+    };
+    std::vector<partial_type> partials( AppJobs::Chunks( 0, nTris, grain ) );
+
+    jobs.ParallelFor( 0, nTris, grain, [&] (size_t first, size_t end) {
+        partial_type& part = partials[ first / grain ];
+        part.first = nVerts;
+        for( size_t t = first; t < end; t++ )
+        {
+            const ind3_type tri = fnTriVerts( triID_type( t ) );
+            part.first = std::min<size_t>( part.first, std::min( tri.x, std::min( tri.y, tri.z ) ) );
+            part.end = std::max<size_t>( part.end, std::max( tri.x, std::max( tri.y, tri.z ) ) + 1 );
+        }
+        part.sums.assign( part.end - part.first, glm::vec3( 0.f ) );
+        part.tris.assign( part.end - part.first, 0 );
+        for( size_t t = first; t < end; t++ )
+        {
+            const ind3_type tri = fnTriVerts( triID_type( t ) );
+            const glm::vec3 value = fnTriValue( triID_type( t ) );
+            part.sums[ tri.x - part.first ] += value; part.tris[ tri.x - part.first ]++;
+            part.sums[ tri.y - part.first ] += value; part.tris[ tri.y - part.first ]++;
+            part.sums[ tri.z - part.first ] += value; part.tris[ tri.z - part.first ]++;
+        }
+    } );
+
+    // aligned to pages so that vertarray_type writes from different threads never share a page
+    jobs.ParallelFor( 0, nVerts, vertarray_type::PageItems * 4, [&] (size_t first, size_t end) {
+        std::vector<glm::vec3> sums( end - first, glm::vec3( 0.f ) );
+        std::vector<uint> tris( end - first, 0 );
+        for( auto& part : partials )
+        {
+            const size_t lo = std::max( first, part.first ), hi = std::min( end, part.end );
+            for( size_t v = lo; v < hi; v++ )
+            {
+                sums[ v - first ] += part.sums[ v - part.first ];
+                tris[ v - first ] += part.tris[ v - part.first ];
+            }
+        }
+        for( size_t v = first; v < end; v++ ) fnVert( vertID_type( v ), sums[ v - first ], tris[ v - first ] );
+    } );
+}
+
 void TriVertNormals(
         std::vector<glm::vec3>& normVerts,
         std::vector<glm::vec3>& normTris,
@@ -44,13 +114,80 @@ void IndTriAdjTris(
         const std::vector<ind3_type>& indTriVerts
 );
 
+// the tris using each vert, ascending. a degenerate tri is listed once per corner
+void IndVertTris(
+        vertTris_type& vertTris,
+        size_t nVerts,
+        const std::vector<ind3_type>& indTriVerts
+);
+
+// the rings of tris AdjTriVisitor works through, kept between visits
+struct adjrings_type
+{
+    std::vector<triID_type> ring, next;
+    std::vector<float> effects;
+};
+
+// breadth-first from triStart over indTriAdjTris, into deq_out, of the tris that are in the patch.
+// a ring of tris at a time goes to effector.Effects(tris, n, effects_out) so the falloff can be
+// evaluated over the ring in one loop. a tri is in the patch when its effect isn't negative
+template<class Effector>
 void AdjTriVisitor(
-    std::deque<trieffect_type>& deq_out,
+    ring_tmpl<trieffect_type>& deq_out,
     triID_type triStart,
     const std::vector<ind3_type>& indTriAdjTris,
     const serial_type serial,
     std::vector<serial_type>& serialMarkings,
-    EffectorFn& fnTriEffector
+    Effector& effector,
+    adjrings_type& rings
+)
+{
+    auto fnQueueForCheck = [&](triID_type tID)
+    {
+        if(tID == TriIDEnd) return;
+        if(serialMarkings[ tID ] != serial)
+        {
+            serialMarkings[ tID ] = serial;
+            rings.next.push_back( tID );
+        }
+    };
+
+    rings.ring.assign( 1, triStart );
+    while( !rings.ring.empty() )
+    {
+        rings.effects.resize( rings.ring.size() );
+        effector.Effects( rings.ring.data(), uint( rings.ring.size() ), rings.effects.data() );
+
+        rings.next.clear();
+        for( size_t i = 0; i < rings.ring.size(); i++ )
+        {
+            if( !( rings.effects[ i ] >= 0.f ) ) continue;
+
+            const triID_type triID = rings.ring[ i ];
+            deq_out.push_back( { triID, rings.effects[ i ] } );
+
+            fnQueueForCheck( indTriAdjTris[ triID ].x );
+            fnQueueForCheck( indTriAdjTris[ triID ].y );
+            fnQueueForCheck( indTriAdjTris[ triID ].z );
+        }
+        rings.ring.swap( rings.next );
+    }
+}
+
+// walks from triStart, where the ray along directionFrom hit, over indTriAdjTris to the tri that the ray
+// along direction hits, following the tris that the sweep between the rays crosses. fills in cxt_out's
+// tri, bary and distance. false when that takes more than steps, or when the walk reaches a tri that
+// faces away or is edge-on or the edge of the mesh. pPath_out gets the tris walked over on the way,
+// without triStart or the tri found
+bool TriWalk(
+    trisearch_type& cxt_out,
+    triID_type triStart,
+    IDefineTri& triangular,
+    glm::vec3 const & position,
+    glm::vec3 const & directionFrom,
+    glm::vec3 const & direction,
+    uint steps,
+    std::vector<triID_type>* pPath_out = 0
 );
 
 #endif //_TRITOOLS_HPP_
@@ -91,7 +91,7 @@ struct RHelix: public IDefineTri, public IRenormalizable
     //std::vector<glm::vec3>& GetPosVerts() final { return posVerts; }
 
     //private:
-    CRubus rubus; // collision body
+    CRubus<IDefineTri> rubus; // collision body, through the virtual adapter
 
 };
 